@@ -755,6 +755,8 @@ SEXP ALTLOGICAL_SUM(SEXP x, Rboolean narm);
 /* constructors for internal ALTREP classes */
 SEXP R_compact_intrange(R_xlen_t n1, R_xlen_t n2);
 SEXP R_deferred_coerceToString(SEXP v, SEXP info);
+SEXP R_mmap_file_region(SEXP file, int fd, double offset, size_t size,
+			 int type);
 SEXP R_virtrep_vec(SEXP, SEXP);
 SEXP R_tryWrap(SEXP);
 SEXP R_tryUnwrap(SEXP);
@@ -1301,6 +1303,16 @@ typedef struct {
 #define UNSET_NO_SPECIAL_SYMBOLS(b) ((b)->sxpinfo.gp &= (~SPECIAL_SYMBOL_MASK))
 #define NO_SPECIAL_SYMBOLS(b) ((b)->sxpinfo.gp & SPECIAL_SYMBOL_MASK)
 
+/* Frames searched by a cached S3 method lookup (objects.c).  Creating
+   or removing bindings in them has to invalidate the cache. */
+#define S3_LOOKUP_FRAME_MASK (1<<13)
+#define IS_S3_LOOKUP_FRAME(e) (ENVFLAGS(e) & S3_LOOKUP_FRAME_MASK)
+#define MARK_AS_S3_LOOKUP_FRAME(e) \
+    SET_ENVFLAGS(e, ENVFLAGS(e) | S3_LOOKUP_FRAME_MASK)
+#define R_S3LookupFrameChanged(e) do {			\
+	if (IS_S3_LOOKUP_FRAME(e)) R_S3MethodsEpoch++;	\
+    } while (0)
+
 #else /* USE_RINTERNALS */
 
 typedef struct VECREC *VECP;
@@ -1567,6 +1579,7 @@ extern0 int	R_Expressions_keep INI_as(5000);/* options(expressions) */
 extern0 Rboolean R_KeepSource	INI_as(FALSE);	/* options(keep.source) */
 extern0 Rboolean R_CBoundsCheck	INI_as(FALSE);	/* options(CBoundsCheck) */
 extern0 MATPROD_TYPE R_Matprod	INI_as(MATPROD_DEFAULT);  /* options(matprod) */
+extern0 int	R_MatchCacheSize INI_as(0);	/* options(match.cache) */
 extern0 int	R_WarnLength	INI_as(1000);	/* Error/warning max length */
 extern0 int	R_nwarnings	INI_as(50);
 
@@ -1675,6 +1688,7 @@ extern0 int R_jit_enabled INI_as(0); /* has to be 0 during R startup */
 extern0 int R_compile_pkgs INI_as(0);
 extern0 int R_check_constants INI_as(0);
 extern0 int R_disable_bytecode INI_as(0);
+extern0 unsigned int R_S3MethodsEpoch INI_as(1); /* for objects.c */
 extern SEXP R_cmpfun1(SEXP); /* unconditional fresh compilation */
 extern void R_init_jit_enabled(void);
 extern void R_initEvalSymbols(void);
@@ -1690,6 +1704,69 @@ void R_BCProtReset(R_bcstack_t *);
 LibExtern int R_num_math_threads INI_as(1);
 LibExtern int R_max_num_math_threads INI_as(1);
 
+/* Element-wise kernels on vectors of at least R_PAR_MIN_LENGTH
+   elements may be run using R_num_math_threads OpenMP threads.
+   R_par_nthreads(n) gives the number of threads to use for a vector
+   of length n, 1 meaning the serial code is to be used. */
+#ifndef R_PAR_MIN_LENGTH
+# define R_PAR_MIN_LENGTH 1000000
+#endif
+int R_par_nthreads(R_xlen_t n);
+
+/* Parallel version of R_ITERATE_CHECK from R_ext/Itermacros.h, for
+   loop bodies that only read and write vector data (no allocation,
+   no R API calls, no errors or warnings).  Each thread handles a
+   contiguous slice of a block of nthreads * ncheck elements and
+   interrupts are checked on the main thread between blocks.  Every
+   element is computed by the same code as in the serial loop, so the
+   results do not depend on the number of threads. */
+#ifdef _OPENMP
+# define R_PAR_PRAGMA_(x) _Pragma(#x)
+# define R_PAR_ITERATE_CORE_(ncheck, n, i, omp_clauses, loop_body) do { \
+	int __nth__ = R_par_nthreads(n);				\
+	R_xlen_t __blk__ = (R_xlen_t) __nth__ * (ncheck);		\
+	for (R_xlen_t __lo__ = 0; __lo__ < (n); __lo__ += __blk__) {	\
+	    R_xlen_t __hi__ =						\
+		(n) - __lo__ > __blk__ ? __lo__ + __blk__ : (n);	\
+	    R_PAR_PRAGMA_(omp parallel for num_threads(__nth__)		\
+			  schedule(static) omp_clauses)			\
+	    for (i = __lo__; i < __hi__; i++) { loop_body }		\
+	    if (__hi__ < (n)) R_CheckUserInterrupt();			\
+	}								\
+    } while (0)
+# define R_PAR_ITERATE_CHECK(ncheck, n, i, loop_body) do {		\
+	if (R_par_nthreads(n) > 1)					\
+	    R_PAR_ITERATE_CORE_(ncheck, n, i, , loop_body);		\
+	else								\
+	    R_ITERATE_CHECK(ncheck, n, i, loop_body);			\
+    } while (0)
+/* As R_ITERATE, without interrupt checks. */
+# define R_PAR_ITERATE(n, i, loop_body) do {				\
+	int __nth__ = R_par_nthreads(n);				\
+	if (__nth__ > 1) {						\
+	    R_PAR_PRAGMA_(omp parallel for num_threads(__nth__)		\
+			  schedule(static))				\
+	    for (i = 0; i < (n); i++) { loop_body }			\
+	}								\
+	else								\
+	    R_ITERATE(n, i, loop_body);					\
+    } while (0)
+/* As R_PAR_ITERATE_CHECK, for loop bodies which may set the integer or
+   bool variable 'flag' to a non-zero value (but never reset it). */
+# define R_PAR_ITERATE_FLAG_CHECK(ncheck, n, i, flag, loop_body) do {	\
+	if (R_par_nthreads(n) > 1)					\
+	    R_PAR_ITERATE_CORE_(ncheck, n, i, reduction(|:flag), loop_body); \
+	else								\
+	    R_ITERATE_CHECK(ncheck, n, i, loop_body);			\
+    } while (0)
+#else
+# define R_PAR_ITERATE(n, i, loop_body) R_ITERATE(n, i, loop_body)
+# define R_PAR_ITERATE_CHECK(ncheck, n, i, loop_body)	\
+    R_ITERATE_CHECK(ncheck, n, i, loop_body)
+# define R_PAR_ITERATE_FLAG_CHECK(ncheck, n, i, flag, loop_body)	\
+    R_ITERATE_CHECK(ncheck, n, i, loop_body)
+#endif
+
 /* Pointer  type and utilities for dispatch in the methods package */
 typedef SEXP (*R_stdGen_ptr_t)(SEXP, SEXP, SEXP); /* typedef */
 //R_stdGen_ptr_t R_get_standardGeneric_ptr(void); /* get method */
@@ -2122,6 +2199,7 @@ SEXP duplicated(SEXP, Rboolean);
 SEXP R_duplicate_attr(SEXP);
 R_xlen_t any_duplicated(SEXP, Rboolean);
 R_xlen_t any_duplicated3(SEXP, SEXP, Rboolean);
+void R_TrimMatchCache(void);
 SEXP evalList(SEXP, SEXP, SEXP, int);
 SEXP evalListKeepMissing(SEXP, SEXP);
 int factorsConform(SEXP, SEXP);
@@ -2417,6 +2495,7 @@ extern int R_OutputCon; /* from connections.c */
 
 extern int R_InitReadItemDepth, R_ReadItemDepth; /* from serialize.c */
 SEXP R_SerializeInfo(R_inpstream_t ips);
+SEXP R_lazyLoadDBfetch(SEXP key, SEXP file, int compressed, SEXP hook);
 
 void get_current_mem(size_t *,size_t *,size_t *); /* from memory.c */
 unsigned long get_duplicate_counter(void);  /* from duplicate.c */
@@ -315,14 +315,71 @@ SEXP R_quick_method_check(SEXP args, SEXP mlist, SEXP fdef)
     return(retValue);
 }
 
+/* The symbol for the label of a class signature, as made by .SigLabel(),
+   from the class names (CHARSXPs) of its n arguments.  Dispatch uses
+   the label to look up the method in the table of the generic.  Labels
+   are cached by the identity of the class names, so that repeated
+   dispatch on the same classes neither builds nor installs the label.
+   As the tables are still searched for the label, the cache needs no
+   invalidation when methods or classes are defined. */
+
+#define SIG_LABEL_CACHE_SIZE 1024
+#define SIG_LABEL_MAX_ARGS 8
+
+static SEXP sig_label_cache = NULL;
+
+static SEXP R_sigLabel(SEXP *classes, int n)
+{
+    uintptr_t h = (uintptr_t) n;
+    int i, k, lwidth = 0;
+    SEXP key, sym;
+
+    for(i = 0; i < n; i++)
+	h = h * 31 + ((uintptr_t) classes[i] >> 4);
+    k = (int) (h % SIG_LABEL_CACHE_SIZE);
+    if(sig_label_cache == NULL) {
+	sig_label_cache = allocVector(VECSXP, 2 * SIG_LABEL_CACHE_SIZE);
+	R_PreserveObject(sig_label_cache);
+    }
+    key = VECTOR_ELT(sig_label_cache, 2 * k);
+    if(key != R_NilValue && LENGTH(key) == n) {
+	for(i = 0; i < n; i++)
+	    if(STRING_ELT(key, i) != classes[i])
+		break;
+	if(i == n)
+	    return VECTOR_ELT(sig_label_cache, 2 * k + 1);
+    }
+
+    for(i = 0; i < n; i++)
+	lwidth += (int) strlen(CHAR(classes[i])) + 1;
+    const void *vmax = vmaxget();
+    char *buf = (char *) R_alloc(lwidth + 1, sizeof(char)), *bufptr = buf;
+    for(i = 0; i < n; i++) {
+	if(i > 0)
+	    *bufptr++ = '#';
+	strcpy(bufptr, CHAR(classes[i]));
+	while(*bufptr)
+	    bufptr++;
+    }
+    *bufptr = '\0';
+    sym = install(buf);
+    vmaxset(vmax);
+    if(n <= SIG_LABEL_MAX_ARGS) {
+	key = allocVector(STRSXP, n);
+	for(i = 0; i < n; i++)
+	    SET_STRING_ELT(key, i, classes[i]);
+	SET_VECTOR_ELT(sig_label_cache, 2 * k, key);
+	SET_VECTOR_ELT(sig_label_cache, 2 * k + 1, sym);
+    }
+    return sym;
+}
+
 SEXP R_quick_dispatch(SEXP args, SEXP genericEnv, SEXP fdef)
 {
     /* Match the list of (possibly promised) args to the methods table. */
     static SEXP  R_allmtable = NULL, R_siglength;
-    SEXP object, value, mtable;
-    const char *class; int nsig, nargs;
-#define NBUF 200
-    char buf[NBUF]; char *ptr;
+    SEXP object, value, mtable, classes[SIG_LABEL_MAX_ARGS];
+    int nsig, nargs;
     if(!R_allmtable) {
 	R_allmtable = install(".AllMTable");
 	R_siglength = install(".SigLength");
@@ -359,43 +416,33 @@ SEXP R_quick_dispatch(SEXP args, SEXP genericEnv, SEXP fdef)
 	UNPROTECT(1); /* mtable */
 	return R_NilValue;
     }
-    buf[0] = '\0'; ptr = buf;
+    if(nsig <= 0 || nsig > SIG_LABEL_MAX_ARGS) {
+	UNPROTECT(1); /* mtable */
+	return R_NilValue;
+    }
+    int nprotect = 1;
     nargs = 0;
     while(!isNull(args) && nargs < nsig) {
 	object = CAR(args); args = CDR(args);
 	if(TYPEOF(object) == PROMSXP)
 	    object = eval(object, Methods_Namespace);
 	if(object == R_MissingArg)
-	    class = "missing";
+	    classes[nargs] = STRING_ELT(s_missing, 0);
 	else {
 	    PROTECT(object);
-	    class = CHAR(STRING_ELT(R_data_class(object, TRUE), 0));
+	    object = R_data_class(object, TRUE);
 	    UNPROTECT(1); /* object */
+	    PROTECT(object); nprotect++; /* keeps the class name */
+	    classes[nargs] = STRING_ELT(object, 0);
 	}
-	if(ptr - buf + strlen(class) + 2 > NBUF) {
-	    UNPROTECT(1); /* mtable */
-	    return R_NilValue;
-	}
-	/* NB:  this code replicates .SigLabel().
-	   If that changes, e.g. to include
-	   the package, the code here must change too.
-	   Or, better, the two should use the same C code. */
-	if(ptr > buf) { ptr = strcpy(ptr, "#");  ptr += 1;}
-	ptr = strcpy(ptr, class); ptr += strlen(class);
 	nargs++;
     }
-    for(; nargs < nsig; nargs++) {
-	if(ptr - buf + strlen("missing") + 2 > NBUF) {
-	    UNPROTECT(1); /* mtable */
-	    return R_NilValue;
-	}
-	ptr = strcpy(ptr, "#"); ptr +=1;
-	ptr = strcpy(ptr, "missing"); ptr += strlen("missing");
-    }
-    value = findVarInFrame(mtable, install(buf));
+    for(; nargs < nsig; nargs++)
+	classes[nargs] = STRING_ELT(s_missing, 0);
+    value = findVarInFrame(mtable, R_sigLabel(classes, nsig));
     if(value == R_UnboundValue)
 	value = R_NilValue;
-    UNPROTECT(1); /* mtable */
+    UNPROTECT(nprotect); /* mtable, classes */
     return(value);
 }
 
@@ -1055,8 +1102,7 @@ SEXP R_dispatchGeneric(SEXP fname, SEXP ev, SEXP fdef)
     int nprotect = 0;
     SEXP mtable, classes, thisClass = R_NilValue /* -Wall */, sigargs,
 	siglength, f_env = R_NilValue, method, f, val = R_NilValue;
-    char *buf, *bufptr;
-    int nargs, i, lwidth = 0;
+    int nargs, i;
 
     if(!R_mtable) {
 	R_mtable = install(".MTable");
@@ -1114,21 +1160,15 @@ SEXP R_dispatchGeneric(SEXP fname, SEXP ev, SEXP fdef)
 	    }
 	}
 	SET_VECTOR_ELT(classes, i, thisClass);
-	lwidth += (int) strlen(STRING_VALUE(thisClass)) + 1;
     }
-    /* make the label */
+    /* look up the method by the label of the signature */
+    SEXP names_buf[SIG_LABEL_MAX_ARGS], *names = names_buf;
     const void *vmax = vmaxget();
-    buf = (char *) R_alloc(lwidth + 1, sizeof(char));
-    bufptr = buf;
-    for(i = 0; i<nargs; i++) {
-	if(i > 0)
-	    *bufptr++ = '#';
-	thisClass = VECTOR_ELT(classes, i);
-	strcpy(bufptr, STRING_VALUE(thisClass));
-	while(*bufptr)
-	    bufptr++;
-    }
-    method = findVarInFrame(mtable, install(buf));
+    if(nargs > SIG_LABEL_MAX_ARGS)
+	names = (SEXP *) R_alloc(nargs, sizeof(SEXP));
+    for(i = 0; i < nargs; i++)
+	names[i] = asChar(VECTOR_ELT(classes, i));
+    method = findVarInFrame(mtable, R_sigLabel(names, nargs));
     vmaxset(vmax);
     if(DUPLICATE_CLASS_CASE(method)) {
 	PROTECT(method);
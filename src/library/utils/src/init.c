@@ -80,8 +80,11 @@ static const R_ExternalMethodDef ExtEntries[] = {
     EXTDEF(download, 6),
 #endif
     EXTDEF(unzip, 7),
-    EXTDEF(Rprof, 10),
+    EXTDEF(Rprof, 11),
+    EXTDEF(Rprofstacks, 0),
     EXTDEF(Rprofmem, 3),
+    EXTDEF(Rprofheap, 2),
+    EXTDEF(Rprofheapsummary, 0),
 
     EXTDEF(countfields, 6),
     EXTDEF(readtablehead, 7),
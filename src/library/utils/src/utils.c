@@ -35,6 +35,12 @@ SEXP Rprof(SEXP args)
     return do_Rprof(CDR(args));
 }
 
+SEXP do_Rprofstacks(SEXP args);
+SEXP Rprofstacks(SEXP args)
+{
+    return do_Rprofstacks(CDR(args));
+}
+
 /* from src/main/memory.c */
 SEXP do_Rprofmem(SEXP args);
 SEXP Rprofmem(SEXP args)
@@ -42,6 +48,18 @@ SEXP Rprofmem(SEXP args)
     return do_Rprofmem(CDR(args));
 }
 
+SEXP do_Rprofheap(SEXP args);
+SEXP Rprofheap(SEXP args)
+{
+    return do_Rprofheap(CDR(args));
+}
+
+SEXP do_Rprofheapsummary(SEXP args);
+SEXP Rprofheapsummary(SEXP args)
+{
+    return do_Rprofheapsummary(CDR(args));
+}
+
 /* from src/main/dounzip.c */
 SEXP Runzip(SEXP args);
 
@@ -27,7 +27,10 @@
 SEXP objectSize(SEXP s);
 SEXP unzip(SEXP args);
 SEXP Rprof(SEXP args);
+SEXP Rprofstacks(SEXP args);
 SEXP Rprofmem(SEXP args);
+SEXP Rprofheap(SEXP args);
+SEXP Rprofheapsummary(SEXP args);
 
 SEXP countfields(SEXP args);
 SEXP flushconsole(void);
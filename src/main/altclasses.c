@@ -25,6 +25,7 @@
 #include <R_ext/Altrep.h>
 #include <float.h> /* for DBL_DIG */
 #include <Print.h> /* for R_print */
+#include <Fileio.h> /* for R_fopen */
 #include <R_ext/Itermacros.h>
 
 #ifdef Win32
@@ -1274,6 +1275,14 @@ static SEXP mmap_file(SEXP file, int type, Rboolean ptrOK, Rboolean wrtOK,
 {
     error("mmap objects not supported on Windows yet");
 }
+
+#ifndef SIMPLEMMAP
+attribute_hidden SEXP R_mmap_file_region(SEXP file, int fd, double offset,
+					 size_t size, int type)
+{
+    return NULL;
+}
+#endif
 #else
 /* derived from the example in
   https://www.safaribooksonline.com/library/view/linux-system-programming/0596009585/ch04s03.html */
@@ -1334,6 +1343,24 @@ static SEXP mmap_file(SEXP file, int type, Rboolean ptrOK, Rboolean wrtOK,
 
     return make_mmap(p, file, sb.st_size, type, ptrOK, wrtOK, serOK);
 }
+
+#ifndef SIMPLEMMAP
+/* Map 'size' bytes of the open file 'fd' from 'offset' as a read-only
+   vector of type 'type', for unserializing the aligned format.
+   Returns NULL if 'offset' is not a multiple of the page size or the
+   mapping fails, for the caller to read the data instead. */
+attribute_hidden SEXP R_mmap_file_region(SEXP file, int fd, double offset,
+					 size_t size, int type)
+{
+    long pagesize = sysconf(_SC_PAGESIZE);
+    if (pagesize <= 0 || (R_size_t) offset % (R_size_t) pagesize != 0)
+	return NULL;
+    void *p = mmap(0, size, PROT_READ, MAP_SHARED, fd, (off_t) offset);
+    if (p == MAP_FAILED)
+	return NULL;
+    return make_mmap(p, file, size, type, TRUE, FALSE, FALSE);
+}
+#endif
 #endif
 
 static Rboolean asLogicalNA(SEXP x, Rboolean dflt)
@@ -1403,6 +1430,382 @@ attribute_hidden SEXP do_munmap_file(SEXP call, SEXP op, SEXP args, SEXP env)
 }
 
 
+/**
+ ** Chunked Vectors
+ **/
+
+/* Chunked vectors are the columns of data frames read lazily by
+   readChunked().  The data of a column is stored in the file in
+   chunks, each a serialized and possibly compressed vector written by
+   lazyLoadDBinsertValue, and a chunked vector represents a contiguous
+   range of its rows.  Elements are read from the file a chunk at a
+   time, and the last chunk read is kept.  Requests for a data pointer
+   read all chunks of the range into an ordinary vector, which is then
+   used instead of the file.  The id written in the header of the file
+   when it was created is checked before each chunk is read, so a
+   vector is never read from another file written under the same
+   name. */
+
+/*
+ * Chunked Vector State
+ */
+
+/* State is held in a LISTSXP of length 5:
+
+       file
+       keys: offsets and lengths of the chunks in a REALSXP
+       starts: the first row of each chunk and the number of rows in a
+               REALSXP of length one more than the number of chunks
+       info: compression type, first row and length in a REALSXP
+       id: the id of the file in a RAWSXP
+
+   Rows are counted from zero. */
+
+#define CHUNKED_STATE_FILE(s) CAR(s)
+#define CHUNKED_STATE_KEYS(s) CADR(s)
+#define CHUNKED_STATE_STARTS(s) CADDR(s)
+#define CHUNKED_STATE_COMPRESSED(s) ((int) REAL(CADDDR(s))[0])
+#define CHUNKED_STATE_FIRST(s) ((R_xlen_t) REAL(CADDDR(s))[1])
+#define CHUNKED_STATE_LENGTH(s) ((R_xlen_t) REAL(CADDDR(s))[2])
+#define CHUNKED_STATE_ID(s) CAD4R(s)
+
+/* the id follows "RDC1\n" at the start of the file */
+#define CHUNKED_ID_OFFSET 5
+#define CHUNKED_ID_SIZE 16
+
+/* Chunked vectors are ALTREP objects with data fields
+
+       data1: the state
+       data2: R_NilValue, or the last chunk read and its index in a
+	      LISTSXP of length 2, or the expanded vector
+
+*/
+
+#define CHUNKED_STATE(x) R_altrep_data1(x)
+#define CHUNKED_CACHE(x) R_altrep_data2(x)
+#define SET_CHUNKED_CACHE(x, v) R_set_altrep_data2(x, v)
+#define CHUNKED_EXPANDED(x) (TYPEOF(CHUNKED_CACHE(x)) == TYPEOF(x))
+
+static R_altrep_class_t chunked_logical_class;
+static R_altrep_class_t chunked_integer_class;
+static R_altrep_class_t chunked_real_class;
+static R_altrep_class_t chunked_string_class;
+
+static void chunked_check_id(SEXP state)
+{
+    SEXP file = CHUNKED_STATE_FILE(state);
+    const char *efn = R_ExpandFileName(translateCharFP(STRING_ELT(file, 0)));
+    unsigned char id[CHUNKED_ID_SIZE];
+    FILE *fp = R_fopen(efn, "rb");
+    if (fp == NULL)
+	error("cannot open file '%s'", translateChar(STRING_ELT(file, 0)));
+    bool ok = fseek(fp, CHUNKED_ID_OFFSET, SEEK_SET) == 0 &&
+	fread(id, 1, CHUNKED_ID_SIZE, fp) == CHUNKED_ID_SIZE &&
+	memcmp(id, RAW(CHUNKED_STATE_ID(state)), CHUNKED_ID_SIZE) == 0;
+    fclose(fp);
+    if (! ok)
+	error("chunked file '%s' has been replaced since it was read",
+	      translateChar(STRING_ELT(file, 0)));
+}
+
+static SEXP chunked_read_chunk(SEXP x, int k)
+{
+    SEXP state = CHUNKED_STATE(x);
+    SEXP file = CHUNKED_STATE_FILE(state);
+    double *keys = REAL(CHUNKED_STATE_KEYS(state));
+    double *starts = REAL(CHUNKED_STATE_STARTS(state));
+
+    chunked_check_id(state);
+    SEXP key = PROTECT(allocVector(REALSXP, 2));
+    REAL(key)[0] = keys[2 * k];
+    REAL(key)[1] = keys[2 * k + 1];
+    SEXP val = R_lazyLoadDBfetch(key, file, CHUNKED_STATE_COMPRESSED(state),
+				 R_NilValue);
+    if (TYPEOF(val) != TYPEOF(x) ||
+	XLENGTH(val) != (R_xlen_t) (starts[k + 1] - starts[k]))
+	error("chunked file '%s' is corrupt",
+	      translateChar(STRING_ELT(file, 0)));
+    UNPROTECT(1); /* key */
+    return val;
+}
+
+/* Returns the chunk holding element i and sets *offset to the index
+   of that element in the chunk. */
+static SEXP chunked_chunk(SEXP x, R_xlen_t i, R_xlen_t *offset)
+{
+    SEXP state = CHUNKED_STATE(x);
+    double *starts = REAL(CHUNKED_STATE_STARTS(state));
+    double row = (double) (CHUNKED_STATE_FIRST(state) + i);
+
+    /* binary search for the last chunk starting at or before row */
+    int lo = 0, hi = LENGTH(CHUNKED_STATE_STARTS(state)) - 2;
+    while (lo < hi) {
+	int mid = (lo + hi + 1) / 2;
+	if (starts[mid] <= row) lo = mid;
+	else hi = mid - 1;
+    }
+    *offset = (R_xlen_t) (row - starts[lo]);
+
+    SEXP cache = CHUNKED_CACHE(x);
+    if (cache != R_NilValue && INTEGER(CADR(cache))[0] == lo)
+	return CAR(cache);
+
+    PROTECT(x);
+    SEXP val = PROTECT(chunked_read_chunk(x, lo));
+    SET_CHUNKED_CACHE(x, list2(val, ScalarInteger(lo)));
+    UNPROTECT(2); /* val, x */
+    return val;
+}
+
+static void chunked_expand(SEXP x)
+{
+    if (! CHUNKED_EXPANDED(x)) {
+	R_xlen_t n = XLENGTH(x);
+	PROTECT(x);
+	SEXP val = PROTECT(allocVector(TYPEOF(x), n));
+	R_xlen_t i = 0;
+	while (i < n) {
+	    R_xlen_t offset;
+	    SEXP chunk = chunked_chunk(x, i, &offset);
+	    R_xlen_t ncopy = XLENGTH(chunk) - offset;
+	    if (ncopy > n - i) ncopy = n - i;
+	    if (TYPEOF(x) == STRSXP)
+		for (R_xlen_t k = 0; k < ncopy; k++)
+		    SET_STRING_ELT(val, i + k, STRING_ELT(chunk, offset + k));
+	    else {
+		size_t size = TYPEOF(x) == REALSXP ? sizeof(double) : sizeof(int);
+		memcpy((char *) DATAPTR(val) + i * size,
+		       (char *) DATAPTR(chunk) + offset * size, ncopy * size);
+	    }
+	    i += ncopy;
+	}
+	SET_CHUNKED_CACHE(x, val);
+	UNPROTECT(2); /* val, x */
+    }
+}
+
+
+/*
+ * ALTREP Methods
+ */
+
+static Rboolean chunked_Inspect(SEXP x, int pre, int deep, int pvec,
+				void (*inspect_subtree)(SEXP, int, int, int))
+{
+    SEXP state = CHUNKED_STATE(x);
+    Rprintf(" chunked %s [%s, %d chunks%s]\n", R_typeToChar(x),
+	    translateChar(STRING_ELT(CHUNKED_STATE_FILE(state), 0)),
+	    LENGTH(CHUNKED_STATE_STARTS(state)) - 1,
+	    CHUNKED_EXPANDED(x) ? ", expanded" : "");
+    return TRUE;
+}
+
+static R_xlen_t chunked_Length(SEXP x)
+{
+    return CHUNKED_STATE_LENGTH(CHUNKED_STATE(x));
+}
+
+
+/*
+ * ALTVEC Methods
+ */
+
+static void *chunked_Dataptr(SEXP x, Rboolean writeable)
+{
+    chunked_expand(x);
+    return DATAPTR_RW(CHUNKED_CACHE(x));
+}
+
+static const void *chunked_Dataptr_or_null(SEXP x)
+{
+    return CHUNKED_EXPANDED(x) ? DATAPTR_RO(CHUNKED_CACHE(x)) : NULL;
+}
+
+
+/*
+ * ALTLOGICAL, ALTINTEGER, ALTREAL and ALTSTRING Methods
+ */
+
+static int chunked_integer_Elt(SEXP x, R_xlen_t i)
+{
+    if (CHUNKED_EXPANDED(x))
+	return INTEGER(CHUNKED_CACHE(x))[i];
+    R_xlen_t offset;
+    SEXP chunk = chunked_chunk(x, i, &offset);
+    return INTEGER(chunk)[offset];
+}
+
+static R_xlen_t
+chunked_integer_Get_region(SEXP x, R_xlen_t i, R_xlen_t n, int *buf)
+{
+    R_xlen_t size = XLENGTH(x);
+    R_xlen_t ncopy = size - i > n ? n : size - i;
+    if (CHUNKED_EXPANDED(x)) {
+	memcpy(buf, INTEGER(CHUNKED_CACHE(x)) + i, ncopy * sizeof(int));
+	return ncopy;
+    }
+    for (R_xlen_t k = 0; k < ncopy; ) {
+	R_xlen_t offset;
+	SEXP chunk = chunked_chunk(x, i + k, &offset);
+	R_xlen_t m = XLENGTH(chunk) - offset;
+	if (m > ncopy - k) m = ncopy - k;
+	memcpy(buf + k, INTEGER(chunk) + offset, m * sizeof(int));
+	k += m;
+    }
+    return ncopy;
+}
+
+static double chunked_real_Elt(SEXP x, R_xlen_t i)
+{
+    if (CHUNKED_EXPANDED(x))
+	return REAL(CHUNKED_CACHE(x))[i];
+    R_xlen_t offset;
+    SEXP chunk = chunked_chunk(x, i, &offset);
+    return REAL(chunk)[offset];
+}
+
+static R_xlen_t
+chunked_real_Get_region(SEXP x, R_xlen_t i, R_xlen_t n, double *buf)
+{
+    R_xlen_t size = XLENGTH(x);
+    R_xlen_t ncopy = size - i > n ? n : size - i;
+    if (CHUNKED_EXPANDED(x)) {
+	memcpy(buf, REAL(CHUNKED_CACHE(x)) + i, ncopy * sizeof(double));
+	return ncopy;
+    }
+    for (R_xlen_t k = 0; k < ncopy; ) {
+	R_xlen_t offset;
+	SEXP chunk = chunked_chunk(x, i + k, &offset);
+	R_xlen_t m = XLENGTH(chunk) - offset;
+	if (m > ncopy - k) m = ncopy - k;
+	memcpy(buf + k, REAL(chunk) + offset, m * sizeof(double));
+	k += m;
+    }
+    return ncopy;
+}
+
+static SEXP chunked_string_Elt(SEXP x, R_xlen_t i)
+{
+    if (CHUNKED_EXPANDED(x))
+	return STRING_ELT(CHUNKED_CACHE(x), i);
+    R_xlen_t offset;
+    SEXP chunk = chunked_chunk(x, i, &offset);
+    return STRING_ELT(chunk, offset);
+}
+
+static void chunked_string_Set_elt(SEXP x, R_xlen_t i, SEXP v)
+{
+    chunked_expand(x);
+    SET_STRING_ELT(CHUNKED_CACHE(x), i, v);
+}
+
+
+/*
+ * Class Objects and Method Tables
+ */
+
+#define CHUNKED_COMMON_METHODS(cls) do {				\
+	R_set_altrep_Inspect_method(cls, chunked_Inspect);		\
+	R_set_altrep_Length_method(cls, chunked_Length);		\
+	R_set_altvec_Dataptr_method(cls, chunked_Dataptr);		\
+	R_set_altvec_Dataptr_or_null_method(cls, chunked_Dataptr_or_null); \
+    } while (0)
+
+static void InitChunkedClasses(void)
+{
+    R_altrep_class_t cls;
+
+    cls = R_make_altlogical_class("chunked_logical", "base", NULL);
+    chunked_logical_class = cls;
+    CHUNKED_COMMON_METHODS(cls);
+    R_set_altlogical_Elt_method(cls, chunked_integer_Elt);
+    R_set_altlogical_Get_region_method(cls, chunked_integer_Get_region);
+
+    cls = R_make_altinteger_class("chunked_integer", "base", NULL);
+    chunked_integer_class = cls;
+    CHUNKED_COMMON_METHODS(cls);
+    R_set_altinteger_Elt_method(cls, chunked_integer_Elt);
+    R_set_altinteger_Get_region_method(cls, chunked_integer_Get_region);
+
+    cls = R_make_altreal_class("chunked_real", "base", NULL);
+    chunked_real_class = cls;
+    CHUNKED_COMMON_METHODS(cls);
+    R_set_altreal_Elt_method(cls, chunked_real_Elt);
+    R_set_altreal_Get_region_method(cls, chunked_real_Get_region);
+
+    cls = R_make_altstring_class("chunked_string", "base", NULL);
+    chunked_string_class = cls;
+    CHUNKED_COMMON_METHODS(cls);
+    R_set_altstring_Elt_method(cls, chunked_string_Elt);
+    R_set_altstring_Set_elt_method(cls, chunked_string_Set_elt);
+}
+
+
+/*
+ * Constructor
+ */
+
+/* .Internal(chunkedVector(file, id, compressed, type, keys, sizes,
+   rows)): 'id' is the id of the file, 'keys' holds the offset and
+   length of each chunk, 'sizes' the number of rows in each, and 'rows'
+   the first row (from one) and the number of rows of the range to
+   represent. */
+attribute_hidden SEXP do_chunkedVector(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    checkArity(op, args);
+    SEXP file = CAR(args); args = CDR(args);
+    SEXP id = CAR(args); args = CDR(args);
+    int compressed = asInteger(CAR(args)); args = CDR(args);
+    SEXP stype = CAR(args); args = CDR(args);
+    SEXP keys = CAR(args); args = CDR(args);
+    SEXP sizes = CAR(args); args = CDR(args);
+    SEXP rows = CAR(args);
+
+    if (TYPEOF(file) != STRSXP || LENGTH(file) != 1 ||
+	STRING_ELT(file, 0) == NA_STRING)
+	error("invalid '%s' argument", "file");
+    if (TYPEOF(id) != RAWSXP || LENGTH(id) != CHUNKED_ID_SIZE)
+	error("invalid '%s' argument", "id");
+    if (! isString(stype) || LENGTH(stype) != 1)
+	error("invalid '%s' argument", "type");
+    SEXPTYPE type = str2type(CHAR(STRING_ELT(stype, 0)));
+    R_altrep_class_t class;
+    switch (type) {
+    case LGLSXP: class = chunked_logical_class; break;
+    case INTSXP: class = chunked_integer_class; break;
+    case REALSXP: class = chunked_real_class; break;
+    case STRSXP: class = chunked_string_class; break;
+    default:
+	error("type '%s' is not supported", CHAR(STRING_ELT(stype, 0)));
+    }
+    if (TYPEOF(keys) != REALSXP || TYPEOF(sizes) != REALSXP ||
+	LENGTH(sizes) == 0 || XLENGTH(keys) != 2 * XLENGTH(sizes))
+	error("invalid '%s' argument", "keys");
+    if (TYPEOF(rows) != REALSXP || LENGTH(rows) != 2)
+	error("invalid '%s' argument", "rows");
+
+    int nchunks = LENGTH(sizes);
+    SEXP starts = PROTECT(allocVector(REALSXP, nchunks + 1));
+    REAL(starts)[0] = 0;
+    for (int k = 0; k < nchunks; k++)
+	REAL(starts)[k + 1] = REAL(starts)[k] + REAL(sizes)[k];
+    double first = REAL(rows)[0] - 1, n = REAL(rows)[1];
+    if (! (first >= 0 && n >= 0 && first + n <= REAL(starts)[nchunks]))
+	error("invalid '%s' argument", "rows");
+
+    SEXP info = PROTECT(allocVector(REALSXP, 3));
+    REAL(info)[0] = compressed;
+    REAL(info)[1] = first;
+    REAL(info)[2] = n;
+
+    SEXP state = PROTECT(list5(file, duplicate(keys), starts, info,
+			       duplicate(id)));
+    SEXP ans = R_new_altrep(class, state, R_NilValue);
+    UNPROTECT(3); /* state, info, starts */
+    return ans;
+}
+
+
 /**
  ** Attribute and Meta Data Wrappers
  **/
@@ -2077,6 +2480,7 @@ attribute_hidden void R_init_altrep(void)
     InitDefferredStringClass();
     InitMmapIntegerClass(NULL);
     InitMmapRealClass(NULL);
+    InitChunkedClasses();
     InitWrapIntegerClass(NULL);
     InitWrapLogicalClass(NULL);
     InitWrapRealClass(NULL);
@@ -283,6 +283,17 @@ static int naflag;
 static SEXP lcall;
 #endif
 
+/* Number of threads for element-wise kernels on vectors of length n,
+   used by R_PAR_ITERATE_CHECK (see Defn.h) here and elsewhere. */
+attribute_hidden int R_par_nthreads(R_xlen_t n)
+{
+#ifdef _OPENMP
+    if (n >= R_PAR_MIN_LENGTH && R_num_math_threads > 1)
+	return R_num_math_threads;
+#endif
+    return 1;
+}
+
 /* Integer arithmetic support */
 
 /* The tests using integer comparisons are a bit faster than the tests
@@ -826,11 +837,15 @@ static SEXP integer_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2, SEXP lcall)
 	    int *pa = INTEGER(ans);
 	    const int *px1 = INTEGER_RO(s1);
 	    const int *px2 = INTEGER_RO(s2);
-	    MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2, {
-		    x1 = px1[i1];
-		    x2 = px2[i2];
-		    pa[i] = R_integer_plus(x1, x2, &naflag);
-		});
+	    if (n1 == n2)
+		R_PAR_ITERATE_FLAG_CHECK(NINTERRUPT, n, i, naflag,
+		    pa[i] = R_integer_plus(px1[i], px2[i], &naflag););
+	    else
+		MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2, {
+			x1 = px1[i1];
+			x2 = px2[i2];
+			pa[i] = R_integer_plus(x1, x2, &naflag);
+		    });
 	    if (naflag)
 		warningcall(lcall, INTEGER_OVERFLOW_WARNING);
 	}
@@ -840,11 +855,15 @@ static SEXP integer_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2, SEXP lcall)
 	    int *pa = INTEGER(ans);
 	    const int *px1 = INTEGER_RO(s1);
 	    const int *px2 = INTEGER_RO(s2);
-	    MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2, {
-		    x1 = px1[i1];
-		    x2 = px2[i2];
-		    pa[i] = R_integer_minus(x1, x2, &naflag);
-		});
+	    if (n1 == n2)
+		R_PAR_ITERATE_FLAG_CHECK(NINTERRUPT, n, i, naflag,
+		    pa[i] = R_integer_minus(px1[i], px2[i], &naflag););
+	    else
+		MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2, {
+			x1 = px1[i1];
+			x2 = px2[i2];
+			pa[i] = R_integer_minus(x1, x2, &naflag);
+		    });
 	    if (naflag)
 		warningcall(lcall, INTEGER_OVERFLOW_WARNING);
 	}
@@ -854,11 +873,15 @@ static SEXP integer_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2, SEXP lcall)
 	    int *pa = INTEGER(ans);
 	    const int *px1 = INTEGER_RO(s1);
 	    const int *px2 = INTEGER_RO(s2);
-	    MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2, {
-		    x1 = px1[i1];
-		    x2 = px2[i2];
-		    pa[i] = R_integer_times(x1, x2, &naflag);
-		});
+	    if (n1 == n2)
+		R_PAR_ITERATE_FLAG_CHECK(NINTERRUPT, n, i, naflag,
+		    pa[i] = R_integer_times(px1[i], px2[i], &naflag););
+	    else
+		MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2, {
+			x1 = px1[i1];
+			x2 = px2[i2];
+			pa[i] = R_integer_times(x1, x2, &naflag);
+		    });
 	    if (naflag)
 		warningcall(lcall, INTEGER_OVERFLOW_WARNING);
 	}
@@ -868,11 +891,15 @@ static SEXP integer_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2, SEXP lcall)
 	    double *pa = REAL(ans);
 	    const int *px1 = INTEGER_RO(s1);
 	    const int *px2 = INTEGER_RO(s2);
-	    MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2, {
-		    x1 = px1[i1];
-		    x2 = px2[i2];
-		    pa[i] = R_integer_divide(x1, x2);
-		});
+	    if (n1 == n2)
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i,
+		    pa[i] = R_integer_divide(px1[i], px2[i]););
+	    else
+		MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2, {
+			x1 = px1[i1];
+			x2 = px2[i2];
+			pa[i] = R_integer_divide(x1, x2);
+		    });
 	}
 	break;
     case POWOP:
@@ -967,14 +994,14 @@ static SEXP real_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2)
 	    const double *dy = REAL_RO(s2);
 	    if (n2 == 1) {
 		double tmp = dy[0];
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] + tmp;);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] + tmp;);
 	    }
 	    else if (n1 == 1) {
 		double tmp = dx[0];
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = tmp + dy[i];);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = tmp + dy[i];);
 	    }
 	    else if (n1 == n2)
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] + dy[i];);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] + dy[i];);
 	    else
 		MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2,
 				  da[i] = dx[i1] + dy[i2];);
@@ -1001,14 +1028,14 @@ static SEXP real_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2)
 	    const double *dy = REAL_RO(s2);
 	    if (n2 == 1) {
 		double tmp = dy[0];
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] - tmp;);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] - tmp;);
 	    }
 	    else if (n1 == 1) {
 		double tmp = dx[0];
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = tmp - dy[i];);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = tmp - dy[i];);
 	    }
 	    else if (n1 == n2)
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] - dy[i];);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] - dy[i];);
 	    else
 		MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2,
 				  da[i] = dx[i1] - dy[i2];);
@@ -1035,14 +1062,14 @@ static SEXP real_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2)
 	    const double *dy = REAL_RO(s2);
 	    if (n2 == 1) {
 		double tmp = dy[0];
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] * tmp;);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] * tmp;);
 	    }
 	    else if (n1 == 1) {
 		double tmp = dx[0];
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = tmp * dy[i];);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = tmp * dy[i];);
 	    }
 	    else if (n1 == n2)
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] * dy[i];);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] * dy[i];);
 	    else
 		MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2,
 				  da[i] = dx[i1] * dy[i2];);
@@ -1069,14 +1096,14 @@ static SEXP real_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2)
 	    const double *dy = REAL_RO(s2);
 	    if (n2 == 1) {
 		double tmp = dy[0];
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] / tmp;);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] / tmp;);
 	    }
 	    else if (n1 == 1) {
 		double tmp = dx[0];
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = tmp / dy[i];);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = tmp / dy[i];);
 	    }
 	    else if (n1 == n2)
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] / dy[i];);
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = dx[i] / dy[i];);
 	    else
 		MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2,
 				  da[i] = dx[i1] / dy[i2];);
@@ -1103,14 +1130,14 @@ static SEXP real_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2)
 	    const double *dy = REAL_RO(s2);
 	    if (n2 == 1) {
 		double tmp = dy[0];
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = R_POW(dx[i], tmp););
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = R_POW(dx[i], tmp););
 	    }
 	    else if (n1 == 1) {
 		double tmp = dx[0];
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = R_POW(tmp, dy[i]););
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = R_POW(tmp, dy[i]););
 	    }
 	    else if (n1 == n2)
-		R_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = R_POW(dx[i], dy[i]););
+		R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, da[i] = R_POW(dx[i], dy[i]););
 	    else
 		MOD_ITERATE2_CHECK(NINTERRUPT, n, n1, n2, i, i1, i2,
 				  da[i] = R_POW(dx[i1], dy[i2]););
@@ -1196,7 +1223,9 @@ static SEXP real_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2)
 
 /* Mathematical Functions of One Argument */
 
-static SEXP math1(SEXP sa, double(*f)(double), SEXP lcall)
+/* 'parallel' says whether f may be called concurrently from several
+   threads, which is not the case for functions which can warn. */
+static SEXP math1(SEXP sa, double(*f)(double), bool parallel, SEXP lcall)
 {
     SEXP sy;
     R_xlen_t i, n;
@@ -1212,18 +1241,23 @@ static SEXP math1(SEXP sa, double(*f)(double), SEXP lcall)
     const double *a = REAL_RO(sa);
     double *y = REAL(sy);
     naflag = 0;
-    for (i = 0; i < n; i++) {
-	double x = a[i]; /* in case y == a */
-	/* This code assumes that ISNAN(x) implies ISNAN(f(x)), so we
-	   only need to check ISNAN(x) if ISNAN(f(x)) is true. */
-	y[i] = f(x);
-	if (ISNAN(y[i])) {
-	    if (ISNAN(x))
-		y[i] = x; /* make sure the incoming NaN is preserved */
-	    else
-		naflag = 1;
-	}
-    }
+    /* This code assumes that ISNAN(x) implies ISNAN(f(x)), so we
+       only need to check ISNAN(x) if ISNAN(f(x)) is true. */
+#define MATH1_BODY do {						\
+	double x = a[i]; /* in case y == a */			\
+	y[i] = f(x);						\
+	if (ISNAN(y[i])) {					\
+	    if (ISNAN(x))					\
+		y[i] = x; /* make sure the incoming NaN is preserved */ \
+	    else						\
+		naflag = 1;					\
+	}							\
+    } while (0)
+    if (parallel)
+	R_PAR_ITERATE_FLAG_CHECK(NINTERRUPT, n, i, naflag, MATH1_BODY;);
+    else
+	for (i = 0; i < n; i++) MATH1_BODY;
+#undef MATH1_BODY
     /* These are primitives, so need to use the call */
     if(naflag) warningcall(lcall, R_MSG_NA);
 
@@ -1247,7 +1281,9 @@ attribute_hidden SEXP do_math1(SEXP call, SEXP op, SEXP args, SEXP env)
     if (isComplex(CAR(args)))
 	return complex_math1(call, op, args, env);
 
-#define MATH1(x) math1(CAR(args), x, call);
+#define MATH1(x) math1(CAR(args), x, true, call);
+    /* the gamma family can warn about loss of precision */
+#define MATH1_SERIAL(x) math1(CAR(args), x, false, call);
     switch (PRIMVAL(op)) {
     case 1: return MATH1(floor);
     case 2: return MATH1(ceil);
@@ -1273,11 +1309,11 @@ attribute_hidden SEXP do_math1(SEXP call, SEXP op, SEXP args, SEXP env)
     case 34: return MATH1(asinh);
     case 35: return MATH1(atanh);
 
-    case 40: return MATH1(lgammafn);
-    case 41: return MATH1(gammafn);
+    case 40: return MATH1_SERIAL(lgammafn);
+    case 41: return MATH1_SERIAL(gammafn);
 
-    case 42: return MATH1(digamma);
-    case 43: return MATH1(trigamma);
+    case 42: return MATH1_SERIAL(digamma);
+    case 43: return MATH1_SERIAL(trigamma);
 	/* case 44: return MATH1(tetragamma);
 	   case 45: return MATH1(pentagamma);
 	   removed in 2.0.0 -- rather use Math2's psigamma()
@@ -1308,7 +1344,7 @@ attribute_hidden SEXP do_trunc(SEXP call, SEXP op, SEXP args, SEXP env)
     check1arg(args, call, "x");
     if (isComplex(CAR(args)))
 	errorcall(call, _("unimplemented complex function"));
-    return math1(CAR(args), trunc, call);
+    return math1(CAR(args), trunc, true, call);
 }
 
 /*
@@ -1752,7 +1788,7 @@ attribute_hidden SEXP do_log_builtin(SEXP call, SEXP op, SEXP args, SEXP env)
 	    if (isComplex(x))
 		res = complex_math1(call, op, args, env);
 	    else
-		res = math1(x, R_log, call);
+		res = math1(x, R_log, true, call);
 	    UNPROTECT(1);
 	    return res;
 	}
@@ -1790,7 +1826,7 @@ attribute_hidden SEXP do_log_builtin(SEXP call, SEXP op, SEXP args, SEXP env)
 	    if (isComplex(CAR(args)))
 		res = complex_math1(call, op, args, env);
 	    else
-		res = math1(CAR(args), R_log, call);
+		res = math1(CAR(args), R_log, true, call);
 	}
 	UNPROTECT(1);
 	return res;
@@ -428,6 +428,7 @@ attribute_hidden SEXP do_parentenvgets(SEXP call, SEXP op, SEXP args, SEXP rho)
 	error(_("'parent' is not an environment"));
 
     SET_ENCLOS(env, parent);
+    R_S3LookupFrameChanged(env);
 
     return( CAR(args) );
 }
@@ -2171,6 +2171,54 @@ static Rconnection newbzfile(const char *description, const char *mode,
 
 #include <lzma.h>
 
+/* The number of threads for xz (de)compression and zstd compression,
+   from option "compress.threads".  The multi-threaded xz encoder (xz >=
+   5.2) writes the data as independently compressed blocks, which the
+   multi-threaded decoder (xz >= 5.4) decompresses in parallel. */
+static int compress_threads(void)
+{
+    int n = asInteger(GetOption1(install("compress.threads")));
+    return (n == NA_INTEGER || n < 1) ? 1 : n;
+}
+
+static lzma_ret xz_stream_encoder(lzma_stream *strm, lzma_filter *filters)
+{
+#if LZMA_VERSION >= 50020002
+    int threads = compress_threads();
+    if (threads > 1) {
+	lzma_mt mt;
+	memset(&mt, 0, sizeof(mt));
+	mt.threads = threads;
+	mt.filters = filters;
+	mt.check = LZMA_CHECK_CRC32;
+	return lzma_stream_encoder_mt(strm, &mt);
+    }
+#endif
+    return lzma_stream_encoder(strm, filters, LZMA_CHECK_CRC32);
+}
+
+/* probably about 80Mb is required, but 512Mb seems OK as a limit */
+#define XZ_MEMLIMIT 536870912
+
+static lzma_ret xz_stream_decoder(lzma_stream *strm)
+{
+#if LZMA_VERSION >= 50040002
+    int threads = compress_threads();
+    if (threads > 1) {
+	lzma_mt mt;
+	memset(&mt, 0, sizeof(mt));
+	mt.flags = LZMA_CONCATENATED;
+	mt.threads = threads;
+	/* the number of threads is reduced to keep within this */
+	mt.memlimit_threading = lzma_physmem() / 4;
+	mt.memlimit_stop = mt.memlimit_threading > XZ_MEMLIMIT ?
+	    mt.memlimit_threading : XZ_MEMLIMIT;
+	return lzma_stream_decoder_mt(strm, &mt);
+    }
+#endif
+    return lzma_stream_decoder(strm, XZ_MEMLIMIT, LZMA_CONCATENATED);
+}
+
 typedef struct xzfileconn {
     FILE *fp;
     lzma_stream stream;
@@ -2209,12 +2257,10 @@ static Rboolean xzfile_open(Rconnection con)
     }
     if(con->canread) {
 	xz->action = LZMA_RUN;
-	/* probably about 80Mb is required, but 512Mb seems OK as a limit */
 	if (xz->type == 1)
-	    ret = lzma_alone_decoder(&xz->stream, 536870912);
+	    ret = lzma_alone_decoder(&xz->stream, XZ_MEMLIMIT);
 	else
-	    ret = lzma_stream_decoder(&xz->stream, 536870912,
-				      LZMA_CONCATENATED);
+	    ret = xz_stream_decoder(&xz->stream);
 	if (ret != LZMA_OK) {
 	    warning(_("cannot initialize lzma decoder, error %d"), ret);
 	    return FALSE;
@@ -2230,7 +2276,7 @@ static Rboolean xzfile_open(Rconnection con)
 	xz->filters[0].options = &(xz->opt_lzma);
 	xz->filters[1].id = LZMA_VLI_UNKNOWN;
 
-	ret = lzma_stream_encoder(strm, xz->filters, LZMA_CHECK_CRC32);
+	ret = xz_stream_encoder(strm, xz->filters);
 	if (ret != LZMA_OK) {
 	    warning(_("cannot initialize lzma encoder, error %d"), ret);
 	    return FALSE;
@@ -2477,7 +2523,10 @@ static Rboolean zstdfile_open(Rconnection con)
 	size_t const buffOutSize = ZSTD_CStreamOutSize(); */
 	ZSTD_CCtx_setParameter(zstd->cc, ZSTD_c_compressionLevel, zstd->compress);
 	ZSTD_CCtx_setParameter(zstd->cc, ZSTD_c_checksumFlag, 1);
-	/* if we want threading: ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, nbThreads); */
+	/* fails harmlessly if libzstd was built without threading */
+	int threads = compress_threads();
+	if (threads > 1)
+	    ZSTD_CCtx_setParameter(zstd->cc, ZSTD_c_nbWorkers, threads);
     }
     con->isopen = TRUE;
     con->text = strchr(con->mode, 'b') ? FALSE : TRUE;
@@ -7125,7 +7174,7 @@ do_memCompress(SEXP call, SEXP op, SEXP args, SEXP env)
 	filters[0].options = &opt_lzma;
 	filters[1].id = LZMA_VLI_UNKNOWN;
 
-	ret = lzma_stream_encoder(&strm, filters, LZMA_CHECK_CRC32);
+	ret = xz_stream_encoder(&strm, filters);
 	if (ret != LZMA_OK) error("internal error %d in memCompress", ret);
 
 	outlen = inlen + inlen/100 + 600; /* FIXME, copied from bzip2 case */
@@ -7326,11 +7375,10 @@ do_memDecompress(SEXP call, SEXP op, SEXP args, SEXP env)
 	lzma_ret ret;
 	while(1) {
 	    /* Initialize lzma_stream in each iteration. */
-	    /* probably at most 80Mb is required, but 512Mb seems OK as a limit */
 	    if (subtype == 1)
-		ret = lzma_alone_decoder(&strm, 536870912);
+		ret = lzma_alone_decoder(&strm, XZ_MEMLIMIT);
 	    else
-		ret = lzma_stream_decoder(&strm, 536870912, LZMA_CONCATENATED);
+		ret = xz_stream_decoder(&strm);
 	    if (ret != LZMA_OK)
 		error(_("cannot initialize lzma decoder, error %d"), ret);
 
@@ -619,9 +619,19 @@ static SEXP R_HashProfile(SEXP table)
    flushed cache entry), the binding LISTSXP cell from the environment
    containing the binding found in a search from R_GlobalEnv, or a
    symbol if the globally visible binding lives in the base package.
-   The cache for a variable is flushed if a new binding for it is
-   created in a global frame or if the variable is removed from any
-   global frame.
+   The symbol is also cached for a variable with no binding at all,
+   unless a user database was searched, so that repeated failed
+   lookups, as by exists(), do not walk the whole search path; a later
+   binding in base is seen directly through the symbol.  The cache for
+   a variable is flushed if a new binding for it is created in a global
+   frame or if the variable is removed from any global frame.
+
+   A second table, R_GlobalFunCache, holds for findFun the location of
+   the first binding in the global frames after R_GlobalEnv, for
+   symbols such as 'c' which R_GlobalEnv binds to a variable, if that
+   binding is a function.  It is flushed together with R_GlobalCache.
+   Functions found past other bindings of the symbol are not cached, as
+   assigning a function to one of those bindings would not flush it.
 
    Symbols in the global cache with values from the base environment
    are flagged with BASE_SYM_CACHED, so that their value can be
@@ -658,7 +668,7 @@ static SEXP R_HashProfile(SEXP table)
 
 #define INITIAL_CACHE_SIZE 1000
 
-static SEXP R_GlobalCache, R_GlobalCachePreserve;
+static SEXP R_GlobalCache, R_GlobalFunCache, R_GlobalCachePreserve;
 #endif
 static SEXP R_BaseNamespaceName;
 static SEXP R_NamespaceSymbol;
@@ -683,6 +693,8 @@ attribute_hidden void InitGlobalEnv(void)
     R_GlobalCache = R_NewHashTable(INITIAL_CACHE_SIZE);
     R_GlobalCachePreserve = CONS(R_GlobalCache, R_NilValue);
     R_PreserveObject(R_GlobalCachePreserve);
+    R_GlobalFunCache = R_NewHashTable(HASHMINSIZE);
+    SETCDR(R_GlobalCachePreserve, CONS(R_GlobalFunCache, R_NilValue));
 #endif
     R_BaseNamespace = NewEnvironment(R_NilValue, R_NilValue, R_GlobalEnv);
     R_PreserveObject(R_BaseNamespace);
@@ -716,6 +728,10 @@ static void R_FlushGlobalCache(SEXP sym)
 	UNSET_BASE_SYM_CACHED(sym);
 #endif
     }
+    entry = R_HashGetLoc(hashIndex(sym, R_GlobalFunCache), sym,
+			 R_GlobalFunCache);
+    if (entry != R_NilValue)
+	SETCAR(entry, R_UnboundValue);
 }
 
 static void R_FlushGlobalCacheFromTable(SEXP table)
@@ -764,6 +780,18 @@ static void R_AddGlobalCache(SEXP symbol, SEXP place)
     }
 }
 
+static void R_AddGlobalFunCache(SEXP symbol, SEXP place)
+{
+    int oldpri = HASHPRI(R_GlobalFunCache);
+    R_HashSet(hashIndex(symbol, R_GlobalFunCache), symbol, R_GlobalFunCache,
+	      place, FALSE);
+    if (oldpri != HASHPRI(R_GlobalFunCache) &&
+	HASHPRI(R_GlobalFunCache) > 0.85 * HASHSIZE(R_GlobalFunCache)) {
+	R_GlobalFunCache = R_HashResize(R_GlobalFunCache);
+	SETCADR(R_GlobalCachePreserve, R_GlobalFunCache);
+    }
+}
+
 static SEXP R_GetGlobalCacheLoc(SEXP symbol)
 {
 #ifdef FAST_BASE_CACHE_LOOKUP
@@ -846,6 +874,7 @@ attribute_hidden void unbindVar(SEXP symbol, SEXP rho)
 	    if (IS_GLOBAL_FRAME(rho))
 		R_FlushGlobalCache(symbol);
 #endif
+	    R_S3LookupFrameChanged(rho);
 	}
     }
     else {
@@ -861,6 +890,8 @@ attribute_hidden void unbindVar(SEXP symbol, SEXP rho)
 	if (found && IS_GLOBAL_FRAME(rho))
 	     R_FlushGlobalCache(symbol);
 #endif
+	if (found)
+	    R_S3LookupFrameChanged(rho);
     }
 }
 
@@ -1185,7 +1216,7 @@ slowpath:
 static SEXP findGlobalVarLoc(SEXP symbol)
 {
     SEXP vl, rho;
-    Rboolean canCache = TRUE;
+    Rboolean canCache = TRUE, canCacheMissing = TRUE;
     vl = R_GetGlobalCacheLoc(symbol);
     if (vl != R_UnboundValue)
 	return vl;
@@ -1197,9 +1228,11 @@ static SEXP findGlobalVarLoc(SEXP symbol)
 		    R_AddGlobalCache(symbol, vl);
 		return vl;
 	    }
+	    if (IS_USER_DATABASE(rho))
+		canCacheMissing = FALSE;
 	}
 	else {
-	    if (SYMVALUE(symbol) != R_UnboundValue)
+	    if (SYMVALUE(symbol) != R_UnboundValue || canCacheMissing)
 		R_AddGlobalCache(symbol, symbol);
 	    return symbol;
 	}
@@ -1217,6 +1250,60 @@ static R_INLINE SEXP findGlobalVar(SEXP symbol)
                     /* loc is protected by callee when needed */
     }
 }
+
+/* findGlobalFun continues the search of findFun3 for a function past a
+   binding of another kind found from R_GlobalEnv, so in the global
+   frames after R_GlobalEnv. */
+static SEXP findGlobalFun(SEXP symbol, SEXP call)
+{
+    SEXP loc, vl, rho;
+    Rboolean canCache = TRUE;
+
+    loc = R_HashGet(hashIndex(symbol, R_GlobalFunCache), symbol,
+		    R_GlobalFunCache);
+    if (loc != R_UnboundValue) {
+	vl = TYPEOF(loc) == SYMSXP ? SYMBOL_BINDING_VALUE(loc) :
+	    BINDING_VALUE(loc);
+	if (TYPEOF(vl) == PROMSXP && PROMISE_IS_EVALUATED(vl))
+	    vl = PRVALUE(vl);
+	if (TYPEOF(vl) == CLOSXP || TYPEOF(vl) == BUILTINSXP ||
+	    TYPEOF(vl) == SPECIALSXP)
+	    return vl;
+    }
+
+    for (rho = ENCLOS(R_GlobalEnv); rho != R_EmptyEnv; rho = ENCLOS(rho)) {
+	loc = findVarLocInFrame(rho, symbol, &canCache);
+	if (loc == R_NilValue)
+	    continue;
+	PROTECT(loc);
+	vl = TYPEOF(loc) == SYMSXP ? SYMBOL_BINDING_VALUE(loc) :
+	    BINDING_VALUE(loc);
+	if (TYPEOF(vl) == PROMSXP) {
+	    if (PROMISE_IS_EVALUATED(vl))
+		vl = PRVALUE(vl);
+	    else {
+		PROTECT(vl);
+		vl = eval(vl, rho);
+		UNPROTECT(1);
+	    }
+	}
+	if (TYPEOF(vl) == CLOSXP || TYPEOF(vl) == BUILTINSXP ||
+	    TYPEOF(vl) == SPECIALSXP) {
+	    if (canCache && ! IS_ACTIVE_BINDING(loc)) {
+		PROTECT(vl);
+		R_AddGlobalFunCache(symbol, loc);
+		UNPROTECT(1); /* vl */
+	    }
+	    UNPROTECT(1); /* loc */
+	    return vl;
+	}
+	canCache = FALSE; /* see the comment on R_GlobalFunCache */
+	UNPROTECT(1); /* loc */
+	if (vl == R_MissingArg)
+	    R_MissingArgError(symbol, call, "getMissingError");
+    }
+    return R_UnboundValue;
+}
 #endif
 
 attribute_hidden SEXP R_findVar(SEXP symbol, SEXP rho)
@@ -1349,6 +1436,18 @@ findVar1mode(SEXP symbol, SEXP rho, SEXPTYPE mode, Rboolean wants_S4,
     if (mode == FUNSXP || mode ==  BUILTINSXP || mode == SPECIALSXP)
 	mode = CLOSXP;
     while (rho != R_EmptyEnv) {
+#ifdef USE_GLOBAL_CACHE
+	/* The global search covers the rest of the search path */
+	if (rho == R_GlobalEnv && inherits && mode == ANYSXP) {
+	    if (doGet)
+		return findGlobalVar(symbol);
+	    vl = findGlobalVarLoc(symbol);
+	    if (vl == R_NilValue ||
+		(TYPEOF(vl) == SYMSXP && SYMVALUE(vl) == R_UnboundValue))
+		return R_UnboundValue;
+	    return R_NilValue;
+	}
+#endif
 	if (! doGet && mode == ANYSXP)
 	    vl = R_existsVarInFrame(rho, symbol) ? R_NilValue : R_UnboundValue;
 	else
@@ -1566,7 +1665,7 @@ SEXP findFun3(SEXP symbol, SEXP rho, SEXP call)
     while (rho != R_EmptyEnv) {
 	/* This is not really right.  Any variable can mask a function */
 #ifdef USE_GLOBAL_CACHE
-	if (rho == R_GlobalEnv)
+	if (rho == R_GlobalEnv) {
 #ifdef FAST_BASE_CACHE_LOOKUP
 	    if (BASE_SYM_CACHED(symbol))
 		vl = SYMBOL_BINDING_VALUE(symbol);
@@ -1575,6 +1674,18 @@ SEXP findFun3(SEXP symbol, SEXP rho, SEXP call)
 #else
 	    vl = findGlobalVar(symbol);
 #endif
+	    /* The global search covers the rest of the search path */
+	    if (vl == R_UnboundValue)
+		break;
+	    if (TYPEOF(vl) != PROMSXP && TYPEOF(vl) != CLOSXP &&
+		TYPEOF(vl) != BUILTINSXP && TYPEOF(vl) != SPECIALSXP &&
+		vl != R_MissingArg) {
+		vl = findGlobalFun(symbol, call);
+		if (vl == R_UnboundValue)
+		    break;
+		return vl;
+	    }
+	}
 	else
 	    vl = R_findVarInFrame(rho, symbol);
 #else
@@ -1643,6 +1754,7 @@ void defineVar(SEXP symbol, SEXP value, SEXP rho)
 #ifdef USE_GLOBAL_CACHE
 	if (IS_GLOBAL_FRAME(rho)) R_FlushGlobalCache(symbol);
 #endif
+	R_S3LookupFrameChanged(rho);
 	return;
     }
 
@@ -1671,6 +1783,7 @@ void defineVar(SEXP symbol, SEXP value, SEXP rho)
 		error(_("cannot add bindings to a locked environment"));
 	    SET_FRAME(rho, CONS(value, FRAME(rho)));
 	    SET_TAG(FRAME(rho), symbol);
+	    R_S3LookupFrameChanged(rho);
 	}
 	else {
 	    c = PRINTNAME(symbol);
@@ -1679,6 +1792,9 @@ void defineVar(SEXP symbol, SEXP value, SEXP rho)
 		SET_HASHASH(c, 1);
 	    }
 	    hashcode = HASHVALUE(c) % HASHSIZE(HASHTAB(rho));
+	    if (IS_S3_LOOKUP_FRAME(rho) &&
+		R_HashGetLoc(hashcode, symbol, HASHTAB(rho)) == R_NilValue)
+		R_S3MethodsEpoch++;
 	    R_HashSet(hashcode, symbol, HASHTAB(rho), value,
 		      (Rboolean) FRAME_IS_LOCKED(rho));
 	    if (R_HashSizeCheck(HASHTAB(rho)))
@@ -1856,6 +1972,8 @@ void gsetVar(SEXP symbol, SEXP value, SEXP rho)
 #ifdef USE_GLOBAL_CACHE
     R_FlushGlobalCache(symbol);
 #endif
+    if (SYMVALUE(symbol) == R_UnboundValue)
+	R_S3MethodsEpoch++;
     SET_SYMBOL_BINDING_VALUE(symbol, value);
 }
 
@@ -1963,6 +2081,7 @@ static int RemoveVariable(SEXP name, int hashcode, SEXP env)
 	table = (R_ObjectTable *) R_ExternalPtrAddr(HASHTAB(env));
 	if(table->remove == NULL)
 	    error(_("cannot remove variables from this database"));
+	R_S3LookupFrameChanged(env);
 	return(table->remove(CHAR(PRINTNAME(name)), table));
     }
 
@@ -1983,6 +2102,8 @@ static int RemoveVariable(SEXP name, int hashcode, SEXP env)
 #endif
 	}
     }
+    if (found)
+	R_S3LookupFrameChanged(env);
     return found;
 }
 
@@ -2622,6 +2743,7 @@ attribute_hidden SEXP do_attach(SEXP call, SEXP op, SEXP args, SEXP env)
 	SET_ENCLOS(t, s);
 	SET_ENCLOS(s, x);
     }
+    R_S3MethodsEpoch++;
 
     if(!isSpecial) { /* Temporary: need to remove the elements identified by objects(CAR(args)) */
 #ifdef USE_GLOBAL_CACHE
@@ -2682,6 +2804,7 @@ attribute_hidden SEXP do_detach(SEXP call, SEXP op, SEXP args, SEXP env)
 	}
 
 	SET_ENCLOS(s, R_BaseEnv);
+	R_S3MethodsEpoch++;
     }
 #ifdef USE_GLOBAL_CACHE
     if(!isSpecial) {
@@ -3475,6 +3598,8 @@ void R_MakeActiveBinding(SEXP sym, SEXP fun, SEXP env)
 	    error(_("symbol already has a regular binding"));
 	else if (BINDING_IS_LOCKED(sym))
 	    error(_("cannot change active binding if binding is locked"));
+	if (SYMVALUE(sym) == R_UnboundValue)
+	    R_S3MethodsEpoch++;
 	SET_SYMVALUE(sym, fun);
 	SET_ACTIVE_BINDING_BIT(sym);
 	/* we don't need to worry about the global cache here as
@@ -3670,6 +3795,7 @@ attribute_hidden SEXP do_mkUnbound(SEXP call, SEXP op, SEXP args, SEXP rho)
 #ifdef USE_GLOBAL_CACHE
     R_FlushGlobalCache(sym);
 #endif
+    R_S3MethodsEpoch++;
     return R_NilValue;
 }
 
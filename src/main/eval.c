@@ -35,12 +35,10 @@
 static SEXP bcEval(SEXP, SEXP);
 static void bcEval_init(void);
 
-/* BC_PROFILING needs to be enabled at build time. It is not enabled
-   by default as enabling it disables the more efficient threaded code
-   implementation of the byte code interpreter. */
-#ifdef BC_PROFILING
+/* Byte code profiling is switched on and off at run time by
+   bcprofstart() and bcprofstop(); while it is off each instruction
+   only pays a test of this flag. */
 static Rboolean bc_profiling = FALSE;
-#endif
 
 static int R_Profiling = 0;
 
@@ -135,6 +133,33 @@ static int R_Filter_Callframes = 0;	      	   /* whether to record only the trai
 typedef enum { RPE_CPU, RPE_ELAPSED } rpe_type;    /* profiling event, CPU time or elapsed time */
 static rpe_type R_Profiling_Event;
 
+/* With Rprof(aggregate = TRUE) the samples are counted by stack in a
+   hash table rather than written to a file.  The table and the pool
+   holding the stack strings are allocated when profiling starts, as
+   the signal handler cannot allocate; stacks which no longer fit are
+   counted as dropped.  The table is kept after profiling stops, until
+   the next aggregated run starts. */
+#define PROFAGG_SLOTS 16384			   /* a power of 2 */
+#define PROFAGG_MAXSTACKS (PROFAGG_SLOTS / 2)
+#define PROFAGG_POOLSIZE (4 << 20)
+
+typedef struct {
+    unsigned int hash;
+    int count;					   /* 0 for an empty slot */
+    size_t offset;				   /* of the stack in the pool */
+} profagg_entry;
+
+static int R_Aggregate_Profiling = 0;
+static struct {
+    profagg_entry *table;
+    char *pool;
+    size_t used;
+    int nstacks, dropped, interval;
+    SEXP filebuf;				   /* R_Srcfiles_buffer of the run */
+    char **files;
+    int nfiles;
+} R_ProfAgg = { NULL, NULL, 0, 0, 0, 0, NULL, NULL, 0 };
+
 #ifdef Win32
 HANDLE MainThread;
 HANDLE ProfileEvent;
@@ -434,6 +459,53 @@ static void pf_int(int num)
 #endif
 }
 
+/* Called from the signal handler: no allocation, no stdio. */
+static void profagg_add(const char *stack)
+{
+    unsigned int hash = 2166136261U;
+    for (const char *p = stack; *p; p++)
+	hash = (hash ^ (unsigned char) *p) * 16777619U;
+
+    for (unsigned int i = hash;; i++) {
+	profagg_entry *e = R_ProfAgg.table + (i & (PROFAGG_SLOTS - 1));
+	if (e->count == 0) {
+	    size_t len = strlen(stack) + 1;
+	    if (R_ProfAgg.nstacks >= PROFAGG_MAXSTACKS ||
+		R_ProfAgg.used + len > PROFAGG_POOLSIZE) {
+		R_ProfAgg.dropped++;
+		return;
+	    }
+	    memcpy(R_ProfAgg.pool + R_ProfAgg.used, stack, len);
+	    e->hash = hash;
+	    e->offset = R_ProfAgg.used;
+	    R_ProfAgg.used += len;
+	    R_ProfAgg.nstacks++;
+	    e->count = 1;
+	    return;
+	}
+	if (e->hash == hash && ! strcmp(R_ProfAgg.pool + e->offset, stack)) {
+	    e->count++;
+	    return;
+	}
+    }
+}
+
+static void profagg_free(void)
+{
+    free(R_ProfAgg.table);
+    free(R_ProfAgg.pool);
+    R_ProfAgg.table = NULL;
+    R_ProfAgg.pool = NULL;
+    R_ProfAgg.used = 0;
+    R_ProfAgg.nstacks = R_ProfAgg.dropped = 0;
+    if (R_ProfAgg.filebuf) {
+	R_ReleaseObject(R_ProfAgg.filebuf);
+	R_ProfAgg.filebuf = NULL;
+    }
+    R_ProfAgg.files = NULL;
+    R_ProfAgg.nfiles = 0;
+}
+
 static void doprof(int sig)  /* sig is ignored in Windows */
 {
     char buf[PROFBUFSIZ];
@@ -567,6 +639,18 @@ static void doprof(int sig)  /* sig is ignored in Windows */
 	R_Profiling_Error = 3;
     }
 
+    if (R_Aggregate_Profiling) {
+	if (strlen(buf))
+	    profagg_add(buf);
+#ifdef Win32
+	ResumeThread(MainThread);
+#else
+	signal(SIGPROF, doprof);
+#endif
+	errno = old_errno;
+	return;
+    }
+
 #ifdef Win32
     /* resume before calling pf_* functions to avoid deadlock */
     ResumeThread(MainThread);
@@ -671,6 +755,17 @@ static void R_EndProfiling(void)
     R_ProfileOutfile = -1;
 #endif /* not Win32 */
     R_Profiling = 0;
+    if (R_Aggregate_Profiling) {
+	/* keep the file names for Rprofstacks() */
+	R_ProfAgg.filebuf = R_Srcfiles_buffer;
+	R_ProfAgg.files = R_Srcfiles;
+	R_ProfAgg.nfiles = R_Line_Profiling ? R_Line_Profiling - 1 : 0;
+	R_Srcfiles_buffer = NULL;
+	R_Aggregate_Profiling = 0;
+	if (R_ProfAgg.dropped)
+	    warning(_("%d samples with too many distinct stacks dropped by Rprof"),
+		    R_ProfAgg.dropped);
+    }
     if (R_Srcfiles_buffer) {
 	R_ReleaseObject(R_Srcfiles_buffer);
 	R_Srcfiles_buffer = NULL;
@@ -689,13 +784,23 @@ static void R_EndProfiling(void)
 static void R_InitProfiling(SEXP filename, int append, double dinterval,
 			    int mem_profiling, int gc_profiling,
 			    int line_profiling, int filter_callframes,
-			    int numfiles, int bufsize, rpe_type event)
+			    int numfiles, int bufsize, rpe_type event,
+			    int aggregate)
 {
 #ifndef Win32
     const void *vmax = vmaxget();
 
-    if(R_ProfileOutfile >= 0) R_EndProfiling();
-    if (filename != NA_STRING && filename) {
+    if(R_ProfileOutfile >= 0 || R_Profiling) R_EndProfiling();
+    if (aggregate) {
+	profagg_free();
+	R_ProfAgg.table = calloc(PROFAGG_SLOTS, sizeof(profagg_entry));
+	R_ProfAgg.pool = malloc(PROFAGG_POOLSIZE);
+	if (R_ProfAgg.table == NULL || R_ProfAgg.pool == NULL) {
+	    profagg_free();
+	    error(_("Rprof: cannot allocate table of stacks"));
+	}
+    }
+    else if (filename != NA_STRING && filename) {
 	const char *fn = R_ExpandFileName(translateCharFP(filename));
 	int flags = O_CREAT | O_WRONLY;
 	if (append)
@@ -712,24 +817,39 @@ static void R_InitProfiling(SEXP filename, int append, double dinterval,
     int wait;
     HANDLE Proc = GetCurrentProcess();
 
-    if(R_ProfileOutfile != NULL) R_EndProfiling();
-    R_ProfileOutfile = RC_fopen(filename, append ? "a" : "w", TRUE);
-    if (R_ProfileOutfile == NULL)
-	error(_("Rprof: cannot open profile file '%s'"),
-	      translateChar(filename));
+    if(R_ProfileOutfile != NULL || R_Profiling) R_EndProfiling();
+    if (aggregate) {
+	profagg_free();
+	R_ProfAgg.table = calloc(PROFAGG_SLOTS, sizeof(profagg_entry));
+	R_ProfAgg.pool = malloc(PROFAGG_POOLSIZE);
+	if (R_ProfAgg.table == NULL || R_ProfAgg.pool == NULL) {
+	    profagg_free();
+	    error(_("Rprof: cannot allocate table of stacks"));
+	}
+    } else {
+	R_ProfileOutfile = RC_fopen(filename, append ? "a" : "w", TRUE);
+	if (R_ProfileOutfile == NULL)
+	    error(_("Rprof: cannot open profile file '%s'"),
+		  translateChar(filename));
+    }
 #endif
     int interval;
 
     interval = (int)(1e6 * dinterval + 0.5);
-    if(mem_profiling)
-	pf_str("memory profiling: ");
-    if(gc_profiling)
-	pf_str("GC profiling: ");
-    if(line_profiling)
-	pf_str("line profiling: ");
-    pf_str("sample.interval=");
-    pf_int(interval); /* %d */
-    pf_str("\n");
+    if (aggregate)
+	R_ProfAgg.interval = interval;
+    else {
+	if(mem_profiling)
+	    pf_str("memory profiling: ");
+	if(gc_profiling)
+	    pf_str("GC profiling: ");
+	if(line_profiling)
+	    pf_str("line profiling: ");
+	pf_str("sample.interval=");
+	pf_int(interval); /* %d */
+	pf_str("\n");
+    }
+    R_Aggregate_Profiling = aggregate;
 
     R_Mem_Profiling=mem_profiling;
     if (mem_profiling)
@@ -847,18 +967,16 @@ SEXP do_Rprof(SEXP args)
 {
     SEXP filename;
     int append_mode, mem_profiling, gc_profiling, line_profiling,
-	filter_callframes;
+	filter_callframes, aggregate;
     double dinterval;
     int numfiles, bufsize;
     const char *event_arg;
     rpe_type event;
 
-#ifdef BC_PROFILING
     if (bc_profiling) {
 	warning("cannot use R profiling while byte code profiling");
 	return R_NilValue;
     }
-#endif
     if (!isString(filename = CAR(args)) || (LENGTH(filename)) != 1)
 	error(_("invalid '%s' argument"), "filename");
 					      args = CDR(args);
@@ -878,6 +996,12 @@ SEXP do_Rprof(SEXP args)
         || STRING_ELT(CAR(args), 0) == NA_STRING)
 	error(_("invalid '%s' argument"), "event");
     event_arg = translateChar(STRING_ELT(CAR(args), 0));
+					      args = CDR(args);
+    aggregate = asLogical(CAR(args));
+    if (aggregate == NA_LOGICAL)
+	error(_("invalid '%s' argument"), "aggregate");
+    if (aggregate && mem_profiling)
+	error(_("memory profiling cannot be aggregated"));
 #ifdef Win32
     if (streql(event_arg, "elapsed") || streql(event_arg, "default"))
 	event = RPE_ELAPSED;
@@ -910,17 +1034,88 @@ SEXP do_Rprof(SEXP args)
     if (LENGTH(filename))
 	R_InitProfiling(filename, append_mode, dinterval, mem_profiling,
 			gc_profiling, line_profiling, filter_callframes,
-			numfiles, bufsize, event);
+			numfiles, bufsize, event, aggregate);
     else
 	R_EndProfiling();
     return R_NilValue;
 }
+
+/* The stacks counted by the current or last aggregated run */
+SEXP do_Rprofstacks(SEXP args)
+{
+    SEXP ans, nms, stacks, samples, files;
+    const void *vmax = vmaxget();
+    int *count = (int *) R_alloc(PROFAGG_MAXSTACKS, sizeof(int));
+    size_t *offset = (size_t *) R_alloc(PROFAGG_MAXSTACKS, sizeof(size_t));
+    char **srcfiles;
+    int n = 0, nfiles, dropped;
+
+    /* Take a snapshot of the counts with the signal handler kept from
+       changing them.  Stacks and file names, once recorded, are not
+       changed until the next run starts. */
+#if !defined(Win32) && defined(HAVE_PTHREAD)
+    sigset_t set, oldset;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &set, &oldset);
+#endif
+    if (R_ProfAgg.table)
+	for (int i = 0; i < PROFAGG_SLOTS; i++)
+	    if (R_ProfAgg.table[i].count) {
+		count[n] = R_ProfAgg.table[i].count;
+		offset[n++] = R_ProfAgg.table[i].offset;
+	    }
+    if (R_Aggregate_Profiling) {
+	srcfiles = R_Srcfiles;
+	nfiles = R_Line_Profiling ? R_Line_Profiling - 1 : 0;
+    } else {
+	srcfiles = R_ProfAgg.files;
+	nfiles = R_ProfAgg.nfiles;
+    }
+    dropped = R_ProfAgg.dropped;
+#if !defined(Win32) && defined(HAVE_PTHREAD)
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+
+    PROTECT(stacks = allocVector(STRSXP, n));
+    PROTECT(samples = allocVector(INTSXP, n));
+    PROTECT(files = allocVector(STRSXP, nfiles));
+    for (int i = 0; i < n; i++) {
+	SET_STRING_ELT(stacks, i, mkChar(R_ProfAgg.pool + offset[i]));
+	INTEGER(samples)[i] = count[i];
+    }
+    for (int i = 0; i < nfiles; i++)
+	SET_STRING_ELT(files, i, mkChar(srcfiles[i]));
+    vmaxset(vmax);
+
+    PROTECT(ans = allocVector(VECSXP, 5));
+    SET_VECTOR_ELT(ans, 0, stacks);
+    SET_VECTOR_ELT(ans, 1, samples);
+    SET_VECTOR_ELT(ans, 2, files);
+    SET_VECTOR_ELT(ans, 3, ScalarReal(R_ProfAgg.interval / 1e6));
+    SET_VECTOR_ELT(ans, 4, ScalarInteger(dropped));
+    PROTECT(nms = allocVector(STRSXP, 5));
+    SET_STRING_ELT(nms, 0, mkChar("stack"));
+    SET_STRING_ELT(nms, 1, mkChar("samples"));
+    SET_STRING_ELT(nms, 2, mkChar("files"));
+    SET_STRING_ELT(nms, 3, mkChar("interval"));
+    SET_STRING_ELT(nms, 4, mkChar("dropped"));
+    setAttrib(ans, R_NamesSymbol, nms);
+    UNPROTECT(5);
+    return ans;
+}
 #else /* not R_PROFILING */
 SEXP do_Rprof(SEXP args)
 {
     error(_("R profiling is not available on this system"));
     return R_NilValue;		/* -Wall */
 }
+
+SEXP do_Rprofstacks(SEXP args)
+{
+    error(_("R profiling is not available on this system"));
+    return R_NilValue;		/* -Wall */
+}
 #endif /* not R_PROFILING */
 
 /* NEEDED: A fixup is needed in browser, because it can trap errors,
@@ -1450,6 +1645,15 @@ static int MIN_JIT_SCORE = 50;
 
 static struct { unsigned long count, envcount, bdcount; } jit_info = {0, 0, 0};
 
+/* Heat counters for the HOT strategy: calls of a closure and loop
+   iterations run by the AST interpreter in its frame.  The table is
+   direct mapped on the closure address; the body is recorded too so
+   that a new closure allocated at the address of a collected one
+   starts from zero. */
+#define JIT_HEAT_SIZE 1024
+static struct { SEXP fun, body; int heat; } JIT_heat_table[JIT_HEAT_SIZE];
+static int JIT_hot_threshold = 100;
+
 attribute_hidden void R_init_jit_enabled(void)
 {
     /* Need to force the lazy loading promise to avoid recursive
@@ -1540,6 +1744,7 @@ static int JIT_score(SEXP e)
 #define STRATEGY_ALL_SMALL_MAYBE 2
 #define STRATEGY_NO_SCORE 3
 #define STRATEGY_NO_CACHE 4
+#define STRATEGY_HOT 5
 /* max strategy index is hardcoded in R_CheckJIT */
 
 /*
@@ -1562,10 +1767,48 @@ static int JIT_score(SEXP e)
           2nd time seen if top-level, never otherwise
       functions with high score compiled
           1st time seen if top-level, 2nd time seen otherwise
+
+  HOT
+      functions compiled when their heat, the number of calls plus
+        the number of loop iterations interpreted in their frames,
+        reaches R_JIT_HOT_THRESHOLD; loops make the next call compile
 */
 
 static int jit_strategy = -1;
 
+static R_INLINE int JIT_heat(SEXP fun, int inc)
+{
+    int i = (int) (((uintptr_t) fun >> 4) % JIT_HEAT_SIZE);
+    if (JIT_heat_table[i].fun != fun || JIT_heat_table[i].body != BODY(fun)) {
+	JIT_heat_table[i].fun = fun;
+	JIT_heat_table[i].body = BODY(fun);
+	JIT_heat_table[i].heat = 0;
+    }
+    if (JIT_heat_table[i].heat < INT_MAX - inc)
+	JIT_heat_table[i].heat += inc;
+    return JIT_heat_table[i].heat;
+}
+
+/* The interpreted closure whose frame is rho, if loops in it should
+   be counted towards its heat. */
+static SEXP JIT_loop_closure(SEXP rho)
+{
+    if (jit_strategy != STRATEGY_HOT || R_jit_enabled <= 0 ||
+	R_disable_bytecode || rho == R_GlobalEnv)
+	return NULL;
+    for (RCNTXT *cptr = R_GlobalContext;
+	 cptr != NULL && cptr->callflag != CTXT_TOPLEVEL;
+	 cptr = cptr->nextcontext)
+	if ((cptr->callflag & CTXT_FUNCTION) && cptr->cloenv == rho) {
+	    SEXP fun = cptr->callfun;
+	    if (TYPEOF(fun) == CLOSXP && TYPEOF(BODY(fun)) != BCODESXP &&
+		! NOJIT(fun))
+		return fun;
+	    break;
+	}
+    return NULL;
+}
+
 static R_INLINE Rboolean R_CheckJIT(SEXP fun)
 {
     /* to help with testing */
@@ -1576,7 +1819,7 @@ static R_INLINE Rboolean R_CheckJIT(SEXP fun)
 	char *valstr = getenv("R_JIT_STRATEGY");
 	if (valstr != NULL)
 	    val = atoi(valstr);
-	if (val < 0 || val > 4)
+	if (val < 0 || val > 5)
 	    jit_strategy = dflt;
 	else
 	    jit_strategy = val;
@@ -1584,6 +1827,10 @@ static R_INLINE Rboolean R_CheckJIT(SEXP fun)
 	valstr = getenv("R_MIN_JIT_SCORE");
 	if (valstr != NULL)
 	    MIN_JIT_SCORE = atoi(valstr);
+
+	valstr = getenv("R_JIT_HOT_THRESHOLD");
+	if (valstr != NULL && atoi(valstr) > 0)
+	    JIT_hot_threshold = atoi(valstr);
     }
 
     SEXP body = BODY(fun);
@@ -1602,6 +1849,9 @@ static R_INLINE Rboolean R_CheckJIT(SEXP fun)
 	    jit_strategy == STRATEGY_NO_CACHE)
 	    return TRUE;
 
+	if (jit_strategy == STRATEGY_HOT)
+	    return JIT_heat(fun, 1) >= JIT_hot_threshold;
+
 	int score = JIT_score(body);
 	if (jit_strategy == STRATEGY_ALL_SMALL_MAYBE)
 	    if (score < MIN_JIT_SCORE) { SET_MAYBEJIT(fun); return FALSE; }
@@ -2757,7 +3007,7 @@ attribute_hidden SEXP do_for(SEXP call, SEXP op, SEXP args, SEXP rho)
        to be safe we declare them volatile as well. */
     volatile R_xlen_t i = 0, n;
     volatile int bgn;
-    volatile SEXP v, val, cell;
+    volatile SEXP v, val, cell, hotfun;
     int dbg, val_type;
     SEXP sym, body;
     RCNTXT cntxt;
@@ -2805,6 +3055,7 @@ attribute_hidden SEXP do_for(SEXP call, SEXP op, SEXP args, SEXP rho)
     INCREMENT_LINKS(val);
 
     PROTECT_WITH_INDEX(v = R_NilValue, &vpi);
+    hotfun = JIT_loop_closure(rho);
 
     begincontext(&cntxt, CTXT_LOOP, R_NilValue, rho, R_BaseEnv, R_NilValue,
 		 R_NilValue);
@@ -2815,6 +3066,8 @@ attribute_hidden SEXP do_for(SEXP call, SEXP op, SEXP args, SEXP rho)
 
     for (i = 0; i < n; i++) {
 
+	if (hotfun != NULL) JIT_heat(hotfun, 1);
+
 	switch (val_type) {
 
 	case EXPRSXP:
@@ -2889,7 +3142,7 @@ attribute_hidden SEXP do_while(SEXP call, SEXP op, SEXP args, SEXP rho)
 {
     int dbg;
     volatile int bgn;
-    volatile SEXP body;
+    volatile SEXP body, hotfun;
     RCNTXT cntxt;
 
     checkArity(op, args);
@@ -2903,11 +3156,13 @@ attribute_hidden SEXP do_while(SEXP call, SEXP op, SEXP args, SEXP rho)
 
     body = CADR(args);
     bgn = BodyHasBraces(body);
+    hotfun = JIT_loop_closure(rho);
 
     begincontext(&cntxt, CTXT_LOOP, R_NilValue, rho, R_BaseEnv, R_NilValue,
 		 R_NilValue);
     if (SETJMP(cntxt.cjmpbuf) != CTXT_BREAK) {
 	for(;;) {
+	    if (hotfun != NULL) JIT_heat(hotfun, 1);
 	    SEXP cond = PROTECT(eval(CAR(args), rho));
 	    int condl = asLogicalNoNA(cond, call);
 	    UNPROTECT(1);
@@ -2935,7 +3190,7 @@ attribute_hidden SEXP do_while(SEXP call, SEXP op, SEXP args, SEXP rho)
 attribute_hidden SEXP do_repeat(SEXP call, SEXP op, SEXP args, SEXP rho)
 {
     int dbg;
-    volatile SEXP body;
+    volatile SEXP body, hotfun;
     RCNTXT cntxt;
 
     checkArity(op, args);
@@ -2948,11 +3203,13 @@ attribute_hidden SEXP do_repeat(SEXP call, SEXP op, SEXP args, SEXP rho)
 	return R_NilValue;
 
     body = CAR(args);
+    hotfun = JIT_loop_closure(rho);
 
     begincontext(&cntxt, CTXT_LOOP, R_NilValue, rho, R_BaseEnv, R_NilValue,
 		 R_NilValue);
     if (SETJMP(cntxt.cjmpbuf) != CTXT_BREAK) {
 	for (;;) {
+	    if (hotfun != NULL) JIT_heat(hotfun, 1);
 	    eval(body, rho);
 	}
     }
@@ -3755,6 +4012,28 @@ attribute_hidden SEXP evalListKeepMissing(SEXP el, SEXP rho)
 }
 
 
+/* Self-evaluating constants, as handled at the top of eval(), gain
+   nothing from being wrapped in a promise: forcing it would just
+   return the constant.  Like the byte code compiler's PUSHCONSTARG,
+   pass them on as values and avoid allocating the promise. */
+
+static R_INLINE SEXP mkArgPromise(SEXP e, SEXP rho)
+{
+    switch (TYPEOF(e)) {
+    case NILSXP:
+    case LGLSXP:
+    case INTSXP:
+    case REALSXP:
+    case STRSXP:
+    case CPLXSXP:
+    case RAWSXP:
+	ENSURE_NAMEDMAX(e);
+	return e;
+    default:
+	return mkPROMISE(e, rho);
+    }
+}
+
 /* Create a promise to evaluate each argument.	Although this is most */
 /* naturally attacked with a recursive algorithm, we use the iterative */
 /* form below because it is does not cause growth of the pointer */
@@ -3804,7 +4083,7 @@ attribute_hidden SEXP promiseArgs(SEXP el, SEXP rho)
 	    COPY_TAG(tail, el);
 	}
 	else {
-	    SETCDR(tail, CONS(mkPROMISE(CAR(el), rho), R_NilValue));
+	    SETCDR(tail, CONS(mkArgPromise(CAR(el), rho), R_NilValue));
 	    tail = CDR(tail);
 	    COPY_TAG(tail, el);
 	}
@@ -4536,7 +4815,7 @@ static SEXP R_DotCSym = NULL;
    instead of a weak reference, stays in the list forever, and is a GC root.*/
 static SEXP R_ConstantsRegistry = NULL;
 
-#if defined(__GNUC__) && ! defined(BC_PROFILING) && (! defined(NO_THREADED_CODE))
+#if defined(__GNUC__) && (! defined(NO_THREADED_CODE))
 # define THREADED_CODE
 #endif
 
@@ -4714,6 +4993,25 @@ enum {
   OPCOUNT
 };
 
+/* Superinstructions are not generated by the compiler: R_bcEncode
+   substitutes them for the first instruction of some common
+   sequences when producing threaded code, and R_bcDecode maps them
+   back. */
+enum {
+  SETVAR_POP_OP = OPCOUNT,
+  LDCONST_ADD_OP,
+  LDCONST_SUB_OP,
+  LDCONST_MUL_OP,
+  LDCONST_DIV_OP,
+  LDCONST_EQ_OP,
+  LDCONST_NE_OP,
+  LDCONST_LT_OP,
+  LDCONST_LE_OP,
+  LDCONST_GE_OP,
+  LDCONST_GT_OP,
+  SUPEROPCOUNT
+};
+
 
 SEXP R_unary(SEXP, SEXP, SEXP);
 SEXP R_binary(SEXP, SEXP, SEXP, SEXP);
@@ -4901,6 +5199,19 @@ static R_INLINE R_bcstack_t *bcStackScalar(R_bcstack_t *s, R_bcstack_t *v)
     }
 }
 
+/* As bcStackScalar, but a logical is returned as an integer, as it is
+   treated in arithmetic and comparisons. */
+static R_INLINE R_bcstack_t *bcStackScalarNum(R_bcstack_t *s, R_bcstack_t *v)
+{
+    R_bcstack_t *p = bcStackScalar(s, v);
+    if (p->tag == LGLSXP) {
+	v->u.ival = p->u.ival;
+	v->tag = INTSXP;
+	return v;
+    }
+    return p;
+}
+
 #define INTEGER_TO_LOGICAL(x) \
     ((x) == NA_INTEGER ? NA_LOGICAL : (x) ? TRUE : FALSE)
 #define INTEGER_TO_REAL(x) ((x) == NA_INTEGER ? NA_REAL : (x))
@@ -4936,8 +5247,8 @@ static R_INLINE R_bcstack_t *bcStackScalarReal(R_bcstack_t *s, R_bcstack_t *v)
 
 #define FastRelop2(op,opval,opsym) do {					\
 	R_bcstack_t vvx, vvy;						\
-	R_bcstack_t *vx = bcStackScalar(R_BCNodeStackTop - 2, &vvx);	\
-	R_bcstack_t *vy = bcStackScalar(R_BCNodeStackTop - 1, &vvy);	\
+	R_bcstack_t *vx = bcStackScalarNum(R_BCNodeStackTop - 2, &vvx);	\
+	R_bcstack_t *vy = bcStackScalarNum(R_BCNodeStackTop - 1, &vvy);	\
 	if (vx->tag == REALSXP && ! ISNAN(vx->u.dval)) {		\
 	    if (vy->tag == REALSXP && ! ISNAN(vy->u.dval))		\
 		DO_FAST_RELOP2(op, vx->u.dval, vy->u.dval);		\
@@ -4954,9 +5265,37 @@ static R_INLINE R_bcstack_t *bcStackScalarReal(R_bcstack_t *s, R_bcstack_t *v)
 	Relop2(opval, opsym);						\
     } while (0)
 
-/* not actually optimized yet; ignore op, opval for now */
-#define FastLogic2(op, opval, opsym) do {		\
-	Builtin2(do_logic, opsym, rho);		\
+/* R's three-valued logic on scalar logicals */
+static R_INLINE int bc_and3(int x, int y)
+{
+    if (x == FALSE || y == FALSE) return FALSE;
+    if (x == NA_LOGICAL || y == NA_LOGICAL) return NA_LOGICAL;
+    return TRUE;
+}
+
+static R_INLINE int bc_or3(int x, int y)
+{
+    if (x == NA_LOGICAL)
+	return (y == NA_LOGICAL || y == FALSE) ? NA_LOGICAL : TRUE;
+    if (y == NA_LOGICAL)
+	return x == FALSE ? NA_LOGICAL : TRUE;
+    return x || y;
+}
+
+/* only two scalar logicals are handled directly */
+#define FastLogic2(fun, opsym) do {					\
+	R_bcstack_t vvx, vvy;						\
+	R_bcstack_t *vx = bcStackScalar(R_BCNodeStackTop - 2, &vvx);	\
+	R_bcstack_t *vy = bcStackScalar(R_BCNodeStackTop - 1, &vvy);	\
+	if (vx->tag == LGLSXP && vy->tag == LGLSXP) {			\
+	    int val = fun(vx->u.ival, vy->u.ival);			\
+	    SKIP_OP();							\
+	    SETSTACK_LOGICAL(-2, val);					\
+	    R_BCNodeStackTop--;						\
+	    R_Visible = TRUE;						\
+	    NEXT();							\
+	}								\
+	Builtin2(do_logic, opsym, rho);					\
     } while (0)
 
 static R_INLINE SEXP getPrimitive(SEXP symbol, SEXPTYPE type)
@@ -5125,7 +5464,7 @@ static SEXP cmp_arith2(SEXP call, int opval, SEXP opsym, SEXP x, SEXP y,
 
 #define FastUnary(op, opsym) do {					\
 	R_bcstack_t vvx;						\
-	R_bcstack_t *vx = bcStackScalar(R_BCNodeStackTop - 1, &vvx);	\
+	R_bcstack_t *vx = bcStackScalarNum(R_BCNodeStackTop - 1, &vvx);	\
 	if (vx->tag == REALSXP) {					\
 	    SKIP_OP();							\
 	    SETSTACK_REAL(-1, op vx->u.dval);				\
@@ -5149,8 +5488,8 @@ static SEXP cmp_arith2(SEXP call, int opval, SEXP opsym, SEXP x, SEXP y,
 		DO_FAST_BINOP(op, sx->u.dval, sy->u.dval);		\
 	}								\
 	R_bcstack_t vvx, vvy;						\
-	R_bcstack_t *vx = bcStackScalar(R_BCNodeStackTop - 2, &vvx);	\
-	R_bcstack_t *vy = bcStackScalar(R_BCNodeStackTop - 1, &vvy);	\
+	R_bcstack_t *vx = bcStackScalarNum(R_BCNodeStackTop - 2, &vvx);	\
+	R_bcstack_t *vy = bcStackScalarNum(R_BCNodeStackTop - 1, &vvy);	\
 	if (vx->tag == REALSXP) {					\
 	    if (vy->tag == REALSXP)					\
 		DO_FAST_BINOP(op, vx->u.dval, vy->u.dval);		\
@@ -5582,14 +5921,27 @@ typedef union { void *v; int i; } BCODE;
    in bcEval stack frames and thus increasing stack usage
    dramatically */
 volatile
-static struct { void *addr; int argc; char *instname; } opinfo[OPCOUNT];
+static struct { void *addr; int argc; char *instname; } opinfo[SUPEROPCOUNT];
 
 #define OP(name,n) \
   case name##_OP: opinfo[name##_OP].addr = (__extension__ &&op_##name); \
     opinfo[name##_OP].argc = (n); \
     opinfo[name##_OP].instname = #name; \
     goto loop; \
-    op_##name
+    op_##name: BC_PROFILE_OP(name##_OP); goto opbody_##name; \
+    opbody_##name
+
+/* A superinstruction takes the place of the instruction 'first' and
+   has the same operands; the instructions it stands for are left in
+   place after it, so a superinstruction can always fall back on
+   executing 'first' and let dispatch continue from there. */
+#define SUPEROP(name,first) \
+  case name##_OP: opinfo[name##_OP].addr = (__extension__ &&op_##name); \
+    opinfo[name##_OP].argc = opinfo[first##_OP].argc; \
+    opinfo[name##_OP].instname = #name; \
+    goto loop; \
+    op_##name: BC_PROFILE_OP(first##_OP); goto opbody_##name; \
+    opbody_##name
 
 #define BEGIN_MACHINE NEXT(); init: { int which = 0; loop: switch(which++)
 #define LASTOP } return R_NilValue
@@ -5612,11 +5964,7 @@ typedef int BCODE;
 
 #define OP(name,argc) case name##_OP
 
-#ifdef BC_PROFILING
-#define BEGIN_MACHINE  loop: currentpc = pc; current_opcode = *pc; switch(*pc++)
-#else
-#define BEGIN_MACHINE  loop: currentpc = pc; switch(*pc++)
-#endif
+#define BEGIN_MACHINE  loop: currentpc = pc; BC_PROFILE_OP(*pc); switch(*pc++)
 #define LASTOP  default: error(_("bad opcode"))
 #define INITIALIZE_MACHINE()
 
@@ -5944,6 +6292,109 @@ static R_INLINE SEXP getvar(SEXP symbol, SEXP rho,
 } while (0)
 #endif
 
+/* 'next' is the macro used to continue after the assignment, so
+   SETVAR_POP can share this code */
+#define DO_SETVAR(next) do {						\
+	int sidx = GETOP();						\
+	SEXP loc;							\
+	if (smallcache)							\
+	    loc = GET_SMALLCACHE_BINDING_CELL(vcache, sidx);		\
+	else {								\
+	    SEXP symbol = GETCONST(constants, sidx);			\
+	    loc = GET_BINDING_CELL_CACHE(symbol, rho, vcache, sidx);	\
+	}								\
+									\
+	R_bcstack_t *s = R_BCNodeStackTop - 1;				\
+	int tag = s->tag;						\
+									\
+	if (tag == BNDCELL_TAG_WR(loc))					\
+	    switch (tag) {						\
+	    case REALSXP: SET_BNDCELL_DVAL(loc, s->u.dval); next();	\
+	    case INTSXP: SET_BNDCELL_IVAL(loc, s->u.ival); next();	\
+	    case LGLSXP: SET_BNDCELL_LVAL(loc, s->u.ival); next();	\
+	    }								\
+	else if (BNDCELL_WRITABLE(loc))					\
+	    switch (tag) {						\
+	    case REALSXP: NEW_BNDCELL_DVAL(loc, s->u.dval); next();	\
+	    case INTSXP: NEW_BNDCELL_IVAL(loc, s->u.ival); next();	\
+	    case LGLSXP: NEW_BNDCELL_LVAL(loc, s->u.ival); next();	\
+	    }								\
+									\
+	SEXP value = GETSTACK(-1);					\
+	INCREMENT_NAMED(value);						\
+	if (! SET_BINDING_VALUE(loc, value)) {				\
+	    SEXP symbol = GETCONST(constants, sidx);			\
+	    PROTECT(value);						\
+	    defineVar(symbol, value, rho);				\
+	    UNPROTECT(1);						\
+	}								\
+	next();								\
+    } while (0)
+
+#ifdef THREADED_CODE
+/* Bodies of the superinstructions.  SETVAR_POP does the POP itself,
+   skipping over the POP instruction.  The LDCONST_<op> instructions
+   handle a scalar double or non-NA integer operand on the stack and a
+   double scalar constant without pushing the constant; otherwise they
+   fall back on LDCONST and the generic <op> instruction following it.
+   Profile counts are kept as if the instructions had been executed
+   one by one. */
+#define SETVAR_POP_NEXT() do {			\
+	BC_PROFILE_OP(POP_OP);			\
+	BCNPOP_IGNORE_VALUE();			\
+	SKIP_OP();				\
+	NEXT();					\
+    } while (0)
+
+#define DO_LDCONST_BINOP(name, fun) do {				\
+	SEXP cval = GETCONST(constants, pc[0].i);			\
+	if (IS_SIMPLE_SCALAR(cval, REALSXP)) {				\
+	    R_bcstack_t vvx;						\
+	    R_bcstack_t *vx = bcStackScalar(R_BCNodeStackTop - 1, &vvx); \
+	    double y = REAL0(cval)[0];					\
+	    if (vx->tag == REALSXP) {					\
+		BC_PROFILE_OP(name##_OP);				\
+		pc += 3; /* the constant, the op and its operand */	\
+		SETSTACK_REAL(-1, fun(vx->u.dval, y));			\
+		R_Visible = TRUE;					\
+		NEXT();							\
+	    }								\
+	    else if (vx->tag == INTSXP && vx->u.ival != NA_INTEGER) {	\
+		BC_PROFILE_OP(name##_OP);				\
+		pc += 3;						\
+		SETSTACK_REAL(-1, fun((double) vx->u.ival, y));		\
+		R_Visible = TRUE;					\
+		NEXT();							\
+	    }								\
+	}								\
+	goto opbody_LDCONST;						\
+    } while (0)
+
+#define DO_LDCONST_RELOP(name, op) do {					\
+	SEXP cval = GETCONST(constants, pc[0].i);			\
+	if (IS_SIMPLE_SCALAR(cval, REALSXP) && ! ISNAN(REAL0(cval)[0])) { \
+	    R_bcstack_t vvx;						\
+	    R_bcstack_t *vx = bcStackScalar(R_BCNodeStackTop - 1, &vvx); \
+	    double y = REAL0(cval)[0];					\
+	    if (vx->tag == REALSXP && ! ISNAN(vx->u.dval)) {		\
+		BC_PROFILE_OP(name##_OP);				\
+		pc += 3;						\
+		SETSTACK_LOGICAL(-1, (vx->u.dval op y) ? TRUE : FALSE);	\
+		R_Visible = TRUE;					\
+		NEXT();							\
+	    }								\
+	    else if (vx->tag == INTSXP && vx->u.ival != NA_INTEGER) {	\
+		BC_PROFILE_OP(name##_OP);				\
+		pc += 3;						\
+		SETSTACK_LOGICAL(-1, (vx->u.ival op y) ? TRUE : FALSE);	\
+		R_Visible = TRUE;					\
+		NEXT();							\
+	    }								\
+	}								\
+	goto opbody_LDCONST;						\
+    } while (0)
+#endif
+
 /* call frame accessors */
 #define CALL_FRAME_FUN() GETSTACK(-3)
 #define CALL_FRAME_ARGS() GETSTACK(-2)
@@ -6214,11 +6665,58 @@ static int tryAssignDispatch(char *generic, SEXP call, SEXP lhs, SEXP rhs,
 } while (0)
 #define isNumericOnly(x) (isNumeric(x) && ! isLogical(x))
 
-#ifdef BC_PROFILING
+/* Byte code profiling data.  Instructions are counted by opcode, by
+   pair of consecutive opcodes and by function; the function is the
+   innermost closure on the context stack when a code object starts
+   executing, identified by the symbol it was called by, and only the
+   first BCPROF_MAXFUNS of them are kept apart.  If the profile timer
+   is available, the opcode and function executing at each tick are
+   recorded as well, as an approximation of the time spent. */
 #define NO_CURRENT_OPCODE -1
+#define BCPROF_MAXFUNS 4096
 static int current_opcode = NO_CURRENT_OPCODE;
-static int opcode_counts[OPCOUNT];
-#endif
+static int current_bcfun = 0;
+static SEXP bcprof_last_body = NULL;
+static double opcode_counts[OPCOUNT], opcode_ticks[OPCOUNT];
+static double *opcode_pair_counts = NULL;
+static SEXP *bcprof_funs = NULL; /* symbols, R_NilValue for anonymous */
+static double *bcprof_fun_counts = NULL, *bcprof_fun_ticks = NULL;
+static int bcprof_nfuns = 0;
+
+static int bcprof_fun_index(void)
+{
+    SEXP fun = R_NilValue;
+    for (RCNTXT *cptr = R_GlobalContext; cptr; cptr = cptr->nextcontext)
+	if ((cptr->callflag & CTXT_FUNCTION) && TYPEOF(cptr->call) == LANGSXP) {
+	    if (TYPEOF(CAR(cptr->call)) == SYMSXP)
+		fun = CAR(cptr->call);
+	    break;
+	}
+    for (int i = 0; i < bcprof_nfuns; i++)
+	if (bcprof_funs[i] == fun)
+	    return i;
+    if (bcprof_nfuns == BCPROF_MAXFUNS)
+	return BCPROF_MAXFUNS; /* the overflow slot */
+    bcprof_funs[bcprof_nfuns] = fun;
+    return bcprof_nfuns++;
+}
+
+static void bcprof_count(int op, SEXP body)
+{
+    opcode_counts[op]++;
+    if (current_opcode != NO_CURRENT_OPCODE)
+	opcode_pair_counts[current_opcode * OPCOUNT + op]++;
+    current_opcode = op;
+    if (body != bcprof_last_body) {
+	bcprof_last_body = body;
+	current_bcfun = bcprof_fun_index();
+    }
+    bcprof_fun_counts[current_bcfun]++;
+}
+
+#define BC_PROFILE_OP(op) do {			\
+	if (bc_profiling) bcprof_count(op, body);	\
+    } while (0)
 
 static void bc_check_sigint(void)
 {
@@ -7163,9 +7661,7 @@ struct bcEval_globals {
     void *oldbcpc;
     R_bcFrame_type *oldbcframe;
     SEXP oldsrcref;
-#ifdef BC_PROFILING
     int old_current_opcode;
-#endif
     R_bcstack_t *old_bcprot_top;
     R_bcstack_t *old_bcprot_committed; // **** not sure this is really needed
     int oldevdepth;
@@ -7179,9 +7675,7 @@ static R_INLINE void save_bcEval_globals(struct bcEval_globals *g)
     g->oldbcpc = R_BCpc;
     g->oldbcframe = R_BCFrame;
     g->oldsrcref = R_Srcref;
-#ifdef BC_PROFILING
     g->old_current_opcode = current_opcode;
-#endif
     g->old_bcprot_top = R_BCProtTop;
     g->old_bcprot_committed = R_BCProtCommitted;
     g->oldevdepth = R_EvalDepth;
@@ -7200,9 +7694,7 @@ static R_INLINE void restore_bcEval_globals(struct bcEval_globals *g)
     R_BCpc = g->oldbcpc;
     R_BCFrame = g->oldbcframe;
     R_Srcref = g->oldsrcref;
-#ifdef BC_PROFILING
     current_opcode = g->old_current_opcode;
-#endif
 }
 
 struct bcEval_locals {
@@ -7843,43 +8335,7 @@ static SEXP bcEval_loop(struct bcEval_locals *ploc)
     OP(LDFALSE, 0): R_Visible = TRUE; BCNPUSH_LOGICAL(FALSE); NEXT();
     OP(GETVAR, 1): DO_GETVAR(FALSE, FALSE);
     OP(DDVAL, 1): DO_GETVAR(TRUE, FALSE);
-    OP(SETVAR, 1):
-      {
-	int sidx = GETOP();
-	SEXP loc;
-	if (smallcache)
-	    loc = GET_SMALLCACHE_BINDING_CELL(vcache, sidx);
-	else {
-	    SEXP symbol = GETCONST(constants, sidx);
-	    loc = GET_BINDING_CELL_CACHE(symbol, rho, vcache, sidx);
-	}
-
-	R_bcstack_t *s = R_BCNodeStackTop - 1;
-	int tag = s->tag;
-
-	if (tag == BNDCELL_TAG_WR(loc))
-	    switch (tag) {
-	    case REALSXP: SET_BNDCELL_DVAL(loc, s->u.dval); NEXT();
-	    case INTSXP: SET_BNDCELL_IVAL(loc, s->u.ival); NEXT();
-	    case LGLSXP: SET_BNDCELL_LVAL(loc, s->u.ival); NEXT();
-	    }
-	else if (BNDCELL_WRITABLE(loc))
-	    switch (tag) {
-	    case REALSXP: NEW_BNDCELL_DVAL(loc, s->u.dval); NEXT();
-	    case INTSXP: NEW_BNDCELL_IVAL(loc, s->u.ival); NEXT();
-	    case LGLSXP: NEW_BNDCELL_LVAL(loc, s->u.ival); NEXT();
-	    }
-
-	SEXP value = GETSTACK(-1);
-	INCREMENT_NAMED(value);
-	if (! SET_BINDING_VALUE(loc, value)) {
-	    SEXP symbol = GETCONST(constants, sidx);
-	    PROTECT(value);
-	    defineVar(symbol, value, rho);
-	    UNPROTECT(1);
-	}
-	NEXT();
-      }
+    OP(SETVAR, 1): DO_SETVAR(NEXT);
     OP(GETFUN, 1):
       {
 	/* get the function */
@@ -8170,8 +8626,8 @@ static SEXP bcEval_loop(struct bcEval_locals *ploc)
     OP(LE, 1): FastRelop2(<=, LEOP, R_LeSym);
     OP(GE, 1): FastRelop2(>=, GEOP, R_GeSym);
     OP(GT, 1): FastRelop2(>, GTOP, R_GtSym);
-    OP(AND, 1): FastLogic2(&, ANDOP, R_AndSym);
-    OP(OR, 1): FastLogic2(|, OROP, R_OrSym);
+    OP(AND, 1): FastLogic2(bc_and3, R_AndSym);
+    OP(OR, 1): FastLogic2(bc_or3, R_OrSym);
     OP(NOT, 1):
       {
 	  R_Visible = TRUE;
@@ -8693,6 +9149,19 @@ static SEXP bcEval_loop(struct bcEval_locals *ploc)
 	  R_BCNodeStackTop--;
 	  NEXT();
       }
+#ifdef THREADED_CODE
+    SUPEROP(SETVAR_POP, SETVAR): DO_SETVAR(SETVAR_POP_NEXT);
+    SUPEROP(LDCONST_ADD, LDCONST): DO_LDCONST_BINOP(ADD, R_ADD);
+    SUPEROP(LDCONST_SUB, LDCONST): DO_LDCONST_BINOP(SUB, R_SUB);
+    SUPEROP(LDCONST_MUL, LDCONST): DO_LDCONST_BINOP(MUL, R_MUL);
+    SUPEROP(LDCONST_DIV, LDCONST): DO_LDCONST_BINOP(DIV, R_DIV);
+    SUPEROP(LDCONST_EQ, LDCONST): DO_LDCONST_RELOP(EQ, ==);
+    SUPEROP(LDCONST_NE, LDCONST): DO_LDCONST_RELOP(NE, !=);
+    SUPEROP(LDCONST_LT, LDCONST): DO_LDCONST_RELOP(LT, <);
+    SUPEROP(LDCONST_LE, LDCONST): DO_LDCONST_RELOP(LE, <=);
+    SUPEROP(LDCONST_GE, LDCONST): DO_LDCONST_RELOP(GE, >=);
+    SUPEROP(LDCONST_GT, LDCONST): DO_LDCONST_RELOP(GT, >);
+#endif
     LASTOP;
   }
 }
@@ -8702,6 +9171,34 @@ static void bcEval_init(void) {
     bcEval_loop(NULL);
 }
 
+/* the superinstruction to use for instruction 'op' followed by 'next',
+   or -1 */
+static int superOp(int op, int next)
+{
+    if (op == SETVAR_OP && next == POP_OP)
+	return SETVAR_POP_OP;
+    if (op == LDCONST_OP)
+	switch (next) {
+	case ADD_OP: return LDCONST_ADD_OP;
+	case SUB_OP: return LDCONST_SUB_OP;
+	case MUL_OP: return LDCONST_MUL_OP;
+	case DIV_OP: return LDCONST_DIV_OP;
+	case EQ_OP: return LDCONST_EQ_OP;
+	case NE_OP: return LDCONST_NE_OP;
+	case LT_OP: return LDCONST_LT_OP;
+	case LE_OP: return LDCONST_LE_OP;
+	case GE_OP: return LDCONST_GE_OP;
+	case GT_OP: return LDCONST_GT_OP;
+	}
+    return -1;
+}
+
+/* the instruction a superinstruction replaces */
+static int superOpFirst(int op)
+{
+    return op == SETVAR_POP_OP ? SETVAR_OP : LDCONST_OP;
+}
+
 attribute_hidden SEXP R_bcEncode(SEXP bytes)
 {
     SEXP code;
@@ -8744,8 +9241,10 @@ attribute_hidden SEXP R_bcEncode(SEXP bytes)
 	    int op = pc[i].i;
 	    if (op < 0 || op >= OPCOUNT)
 		error("unknown instruction code");
-	    pc[i].v = opinfo[op].addr;
-	    i += opinfo[op].argc + 1;
+	    int next = i + opinfo[op].argc + 1;
+	    int super = next < n ? superOp(op, ipc[next]) : -1;
+	    pc[i].v = opinfo[super >= 0 ? super : op].addr;
+	    i = next;
 	}
 
 	return code;
@@ -8756,9 +9255,9 @@ static int findOp(void *addr)
 {
     int i;
 
-    for (i = 0; i < OPCOUNT; i++)
+    for (i = 0; i < SUPEROPCOUNT; i++)
 	if (opinfo[i].addr == addr)
-	    return i;
+	    return i < OPCOUNT ? i : superOpFirst(i);
     error(_("cannot find index for threaded code address"));
     return 0; /* not reached */
 }
@@ -9233,50 +9732,122 @@ attribute_hidden SEXP do_getconst(SEXP call, SEXP op, SEXP args, SEXP env)
     return ans;
 }
 
-#ifdef BC_PROFILING
+#if defined(R_PROFILING) && !defined(Win32)
+# define BCPROF_TIMER
+#endif
+
 attribute_hidden
 SEXP do_bcprofcounts(SEXP call, SEXP op, SEXP args, SEXP env)
 {
-    SEXP val;
-    int i;
-
     checkArity(op, args);
-    val = allocVector(INTSXP, OPCOUNT);
-    for (i = 0; i < OPCOUNT; i++)
-	INTEGER(val)[i] = opcode_counts[i];
+    const char *names[] = {"counts", "ticks", "pairs", "functions",
+			   "function.counts", "function.ticks", "interval", ""};
+    SEXP val = PROTECT(mkNamed(VECSXP, names));
+    int nf = bcprof_nfuns, nfs = nf;
+    if (bcprof_fun_counts != NULL && bcprof_fun_counts[BCPROF_MAXFUNS] > 0)
+	nfs++; /* functions beyond the first BCPROF_MAXFUNS */
+
+    SEXP counts = allocVector(REALSXP, OPCOUNT);
+    SET_VECTOR_ELT(val, 0, counts);
+    SEXP ticks = allocVector(REALSXP, OPCOUNT);
+    SET_VECTOR_ELT(val, 1, ticks);
+    for (int i = 0; i < OPCOUNT; i++) {
+	REAL(counts)[i] = opcode_counts[i];
+	REAL(ticks)[i] = opcode_ticks[i];
+    }
+    SEXP pairs = allocMatrix(REALSXP, OPCOUNT, OPCOUNT);
+    SET_VECTOR_ELT(val, 2, pairs);
+    /* opcode_pair_counts is indexed by [from * OPCOUNT + to]: store it
+       with 'from' as the row */
+    for (int i = 0; i < OPCOUNT; i++)
+	for (int j = 0; j < OPCOUNT; j++)
+	    REAL(pairs)[i + j * OPCOUNT] = opcode_pair_counts ?
+		opcode_pair_counts[i * OPCOUNT + j] : 0;
+
+    SEXP funs = allocVector(STRSXP, nfs);
+    SET_VECTOR_ELT(val, 3, funs);
+    SEXP fcounts = allocVector(REALSXP, nfs);
+    SET_VECTOR_ELT(val, 4, fcounts);
+    SEXP fticks = allocVector(REALSXP, nfs);
+    SET_VECTOR_ELT(val, 5, fticks);
+    for (int i = 0; i < nfs; i++) {
+	int k = i < nf ? i : BCPROF_MAXFUNS;
+	SET_STRING_ELT(funs, i,
+		       k == BCPROF_MAXFUNS ? mkChar("<other>") :
+		       bcprof_funs[k] == R_NilValue ? mkChar("<Anonymous>") :
+		       PRINTNAME(bcprof_funs[k]));
+	REAL(fcounts)[i] = bcprof_fun_counts[k];
+	REAL(fticks)[i] = bcprof_fun_ticks[k];
+    }
+#ifdef BCPROF_TIMER
+    SET_VECTOR_ELT(val, 6, ScalarReal(0.02));
+#else
+    SET_VECTOR_ELT(val, 6, ScalarReal(NA_REAL));
+#endif
+    UNPROTECT(1);
     return val;
 }
 
+#ifdef BCPROF_TIMER
 static void dobcprof(int sig)
 {
-    if (current_opcode >= 0 && current_opcode < OPCOUNT)
-	opcode_counts[current_opcode]++;
+    if (current_opcode >= 0 && current_opcode < OPCOUNT) {
+	opcode_ticks[current_opcode]++;
+	bcprof_fun_ticks[current_bcfun]++;
+    }
     signal(SIGPROF, dobcprof);
 }
 
+static void dobcprof_null(int sig)
+{
+    signal(SIGPROF, dobcprof_null);
+}
+#endif
+
 attribute_hidden
 SEXP do_bcprofstart(SEXP call, SEXP op, SEXP args, SEXP env)
 {
-    struct itimerval itv;
-    int interval;
-    double dinterval = 0.02;
-    int i;
-
     checkArity(op, args);
     if (R_Profiling)
 	error(_("profile timer in use"));
     if (bc_profiling)
 	error(_("already byte code profiling"));
 
+    /* initialize the profile data */
+    if (opcode_pair_counts == NULL) {
+	opcode_pair_counts = calloc(OPCOUNT * OPCOUNT, sizeof(double));
+	bcprof_funs = calloc(BCPROF_MAXFUNS + 1, sizeof(SEXP));
+	bcprof_fun_counts = calloc(BCPROF_MAXFUNS + 1, sizeof(double));
+	bcprof_fun_ticks = calloc(BCPROF_MAXFUNS + 1, sizeof(double));
+	if (opcode_pair_counts == NULL || bcprof_funs == NULL ||
+	    bcprof_fun_counts == NULL || bcprof_fun_ticks == NULL) {
+	    free(opcode_pair_counts);
+	    free(bcprof_funs);
+	    free(bcprof_fun_counts);
+	    free(bcprof_fun_ticks);
+	    opcode_pair_counts = NULL;
+	    error(_("cannot allocate memory for byte code profiling"));
+	}
+    }
+    current_opcode = NO_CURRENT_OPCODE;
+    current_bcfun = 0;
+    bcprof_last_body = NULL;
+    bcprof_nfuns = 0;
+    for (int i = 0; i < OPCOUNT; i++)
+	opcode_counts[i] = opcode_ticks[i] = 0;
+    memset(opcode_pair_counts, 0, OPCOUNT * OPCOUNT * sizeof(double));
+    memset(bcprof_fun_counts, 0, (BCPROF_MAXFUNS + 1) * sizeof(double));
+    memset(bcprof_fun_ticks, 0, (BCPROF_MAXFUNS + 1) * sizeof(double));
+
+#ifdef BCPROF_TIMER
+    struct itimerval itv;
+    int interval;
+    double dinterval = 0.02;
+
     /* according to man setitimer, it waits until the next clock
        tick, usually 10ms, so avoid too small intervals here */
     interval = 1e6 * dinterval + 0.5;
 
-    /* initialize the profile data */
-    current_opcode = NO_CURRENT_OPCODE;
-    for (i = 0; i < OPCOUNT; i++)
-	opcode_counts[i] = 0;
-
     signal(SIGPROF, dobcprof);
 
     itv.it_interval.tv_sec = interval / 1000000;
@@ -9287,54 +9858,36 @@ SEXP do_bcprofstart(SEXP call, SEXP op, SEXP args, SEXP env)
 	(suseconds_t) (interval - itv.it_value.tv_sec * 1000000);
     if (setitimer(ITIMER_PROF, &itv, NULL) == -1)
 	error(_("setting profile timer failed"));
+#endif
 
     bc_profiling = TRUE;
 
     return R_NilValue;
 }
 
-static void dobcprof_null(int sig)
-{
-    signal(SIGPROF, dobcprof_null);
-}
-
 attribute_hidden
 SEXP do_bcprofstop(SEXP call, SEXP op, SEXP args, SEXP env)
 {
-    struct itimerval itv;
-
     checkArity(op, args);
     if (! bc_profiling)
 	error(_("not byte code profiling"));
 
+#ifdef BCPROF_TIMER
+    struct itimerval itv;
+
     itv.it_interval.tv_sec = 0;
     itv.it_interval.tv_usec = 0;
     itv.it_value.tv_sec = 0;
     itv.it_value.tv_usec = 0;
     setitimer(ITIMER_PROF, &itv, NULL);
     signal(SIGPROF, dobcprof_null);
+#endif
 
     bc_profiling = FALSE;
+    current_opcode = NO_CURRENT_OPCODE;
 
     return R_NilValue;
 }
-#else
-NORET attribute_hidden
-SEXP do_bcprofcounts(SEXP call, SEXP op, SEXP args, SEXP env) {
-    checkArity(op, args);
-    error(_("byte code profiling is not supported in this build"));
-}
-NORET attribute_hidden
-SEXP do_bcprofstart(SEXP call, SEXP op, SEXP args, SEXP env) {
-    checkArity(op, args);
-    error(_("byte code profiling is not supported in this build"));
-}
-NORET attribute_hidden
-SEXP do_bcprofstop(SEXP call, SEXP op, SEXP args, SEXP env) {
-    checkArity(op, args);
-    error(_("byte code profiling is not supported in this build"));
-}
-#endif
 
 /* end of byte code section */
 
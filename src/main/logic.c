@@ -207,33 +207,30 @@ static SEXP lunary(SEXP call, SEXP op, SEXP arg)
 	{
 	    int *px = LOGICAL(x);
 	    const int *parg = LOGICAL_RO(arg);
-	    for (i = 0; i < len; i++) {
-//	        if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
+	    R_PAR_ITERATE(len, i, {
 		int v = parg[i];
 		px[i] = (v == NA_LOGICAL) ? NA_LOGICAL : v == 0;
-	    }
+	    });
 	}
 	break;
     case INTSXP:
 	{
 	    int *px = LOGICAL(x);
 	    const int *parg = INTEGER_RO(arg);
-	    for (i = 0; i < len; i++) {
-//	        if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
+	    R_PAR_ITERATE(len, i, {
 		int v = parg[i];
 		px[i] = (v == NA_INTEGER) ? NA_LOGICAL : v == 0;
-	    }
+	    });
 	}
 	break;
     case REALSXP:
 	{
 	    int *px = LOGICAL(x);
 	    const double *parg = REAL_RO(arg);
-	    for (i = 0; i < len; i++){
-//	        if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
+	    R_PAR_ITERATE(len, i, {
 		double v = parg[i];
 		px[i] = ISNAN(v) ? NA_LOGICAL : v == 0;
-	    }
+	    });
 	}
 	break;
     case CPLXSXP:
@@ -321,10 +318,41 @@ attribute_hidden SEXP do_logic2(SEXP call, SEXP op, SEXP args, SEXP env)
     return ScalarLogical(ans);
 }
 
+/* Element-wise & and | on logical values, written with selections
+   rather than branches on NA so that the loops using them can be
+   vectorized.  Any non-zero non-NA value counts as TRUE. */
+static R_INLINE int logical_and(int x1, int x2)
+{
+    return ((x1 == 0) | (x2 == 0)) ? 0 :
+	((x1 == NA_LOGICAL) | (x2 == NA_LOGICAL)) ? NA_LOGICAL : 1;
+}
+
+static R_INLINE int logical_or(int x1, int x2)
+{
+    return (((x1 != NA_LOGICAL) & (x1 != 0)) |
+	    ((x2 != NA_LOGICAL) & (x2 != 0))) ? 1 :
+	((x1 == 0) & (x2 == 0)) ? 0 : NA_LOGICAL;
+}
+
+#define LOGIC_BINARY(FUN) do {						\
+	if (n1 == n2)							\
+	    R_PAR_ITERATE(n, i, pa[i] = FUN(px1[i], px2[i]););		\
+	else if (n2 == 1) {						\
+	    int x2 = px2[0];						\
+	    R_PAR_ITERATE(n, i, pa[i] = FUN(px1[i], x2););		\
+	}								\
+	else if (n1 == 1) {						\
+	    int x1 = px1[0];						\
+	    R_PAR_ITERATE(n, i, pa[i] = FUN(x1, px2[i]););		\
+	}								\
+	else								\
+	    MOD_ITERATE2(n, n1, n2, i, i1, i2,				\
+			 pa[i] = FUN(px1[i1], px2[i2]););		\
+    } while (0)
+
 static SEXP binaryLogic(int code, SEXP s1, SEXP s2)
 {
     R_xlen_t i, n, n1, n2, i1, i2;
-    int x1, x2;
     SEXP ans;
 
     n1 = XLENGTH(s1);
@@ -336,36 +364,16 @@ static SEXP binaryLogic(int code, SEXP s1, SEXP s2)
     }
     ans = allocVector(LGLSXP, n);
 
-    int *px1 = LOGICAL(s1);
-    int *px2 = LOGICAL(s2);
+    const int *px1 = LOGICAL_RO(s1);
+    const int *px2 = LOGICAL_RO(s2);
     int *pa = LOGICAL(ans);
 
     switch (code) {
     case 1:		/* & : AND */
-	MOD_ITERATE2(n, n1, n2, i, i1, i2, {
-//	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
-	    x1 = px1[i1];
-	    x2 = px2[i2];
-	    if (x1 == 0 || x2 == 0)
-		pa[i] = 0;
-	    else if (x1 == NA_LOGICAL || x2 == NA_LOGICAL)
-		pa[i] = NA_LOGICAL;
-	    else
-		pa[i] = 1;
-	});
+	LOGIC_BINARY(logical_and);
 	break;
     case 2:		/* | : OR */
-	MOD_ITERATE2(n, n1, n2, i, i1, i2, {
-//	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
-	    x1 = px1[i1];
-	    x2 = px2[i2];
-	    if ((x1 != NA_LOGICAL && x1) || (x2 != NA_LOGICAL && x2))
-		pa[i] = 1;
-	    else if (x1 == 0 && x2 == 0)
-		pa[i] = 0;
-	    else
-		pa[i] = NA_LOGICAL;
-	});
+	LOGIC_BINARY(logical_or);
 	break;
     case 3:
 	error(_("Unary operator `!' called with two arguments"));
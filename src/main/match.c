@@ -176,6 +176,130 @@ attribute_hidden SEXP matchArgExact(SEXP tag, SEXP * list)
 #define SET_ARGUSED(x,v) SETLEVELS(x,v)
 
 
+/* Cache of argument matches.  Which formal each supplied argument goes
+   to depends only on the formals and on the tags of the supplied
+   arguments, as long as none of these is missing, so a match found by
+   the passes below is remembered keyed by the formals and the tags and
+   replayed by later calls with the same shape.  Only calls with some
+   tagged arguments are cached: positional matching is cheap anyway,
+   whereas tags need string comparisons with each formal.  Entries are
+   VECSXPs holding the formals, the map from supplied argument to
+   formal index (-1 for ...) followed by the index of ... (or -1), and
+   the supplied tags.  Keeping the formals in the cache also keeps
+   their address from being reused. */
+
+#define ARGMATCH_CACHE_SIZE 1024
+#define ARGMATCH_MAX_ARGS 32
+static SEXP ArgMatchCache = NULL;
+
+static R_INLINE unsigned int argmatch_hash(SEXP formals, SEXP supplied)
+{
+    uintptr_t h = (uintptr_t) formals >> 3;
+    for (SEXP b = supplied; b != R_NilValue; b = CDR(b))
+	h = h * 31 + ((uintptr_t) TAG(b) >> 3);
+    return (unsigned int) (h % ARGMATCH_CACHE_SIZE);
+}
+
+/* Returns the shape's cache index if the call can be cached, else -1. */
+static R_INLINE int argmatch_cacheable(SEXP formals, SEXP supplied,
+				       int *nsupplied)
+{
+    int n = 0;
+    Rboolean tagged = FALSE;
+    if (R_warn_partial_match_args)
+	return -1;
+    for (SEXP b = supplied; b != R_NilValue; b = CDR(b), n++) {
+	if (CAR(b) == R_MissingArg || n == ARGMATCH_MAX_ARGS)
+	    return -1;
+	if (TAG(b) != R_NilValue)
+	    tagged = TRUE;
+    }
+    *nsupplied = n;
+    return tagged ? (int) argmatch_hash(formals, supplied) : -1;
+}
+
+static R_INLINE SEXP argmatch_lookup(int h, SEXP formals, SEXP supplied,
+				     int n)
+{
+    if (ArgMatchCache == NULL)
+	return NULL;
+    SEXP entry = VECTOR_ELT(ArgMatchCache, h);
+    if (entry == R_NilValue || XLENGTH(entry) != n + 2 ||
+	VECTOR_ELT(entry, 0) != formals)
+	return NULL;
+    int i = 2;
+    for (SEXP b = supplied; b != R_NilValue; b = CDR(b), i++)
+	if (VECTOR_ELT(entry, i) != TAG(b))
+	    return NULL;
+    return entry;
+}
+
+static void argmatch_store(int h, SEXP formals, SEXP supplied, int n,
+			   const int *map, int dots_i)
+{
+    if (ArgMatchCache == NULL)
+	R_PreserveObject(ArgMatchCache =
+			 allocVector(VECSXP, ARGMATCH_CACHE_SIZE));
+    SEXP entry = PROTECT(allocVector(VECSXP, n + 2));
+    SEXP imap = allocVector(INTSXP, n + 1);
+    SET_VECTOR_ELT(entry, 1, imap);
+    for (int i = 0; i < n; i++)
+	INTEGER(imap)[i] = map[i];
+    INTEGER(imap)[n] = dots_i;
+    SET_VECTOR_ELT(entry, 0, formals);
+    int i = 2;
+    for (SEXP b = supplied; b != R_NilValue; b = CDR(b), i++)
+	SET_VECTOR_ELT(entry, i, TAG(b));
+    SET_VECTOR_ELT(ArgMatchCache, h, entry);
+    UNPROTECT(1);
+}
+
+/* Build the matched list as matchArgs_NR would from a cached match */
+static SEXP argmatch_replay(SEXP entry, SEXP formals, SEXP supplied, int n)
+{
+    int nformals = length(formals), ndots = 0;
+    SEXP a, b, actuals = R_NilValue;
+
+    PROTECT(entry);
+    for (int k = 0; k < nformals; k++) {
+	actuals = CONS_NR(R_MissingArg, actuals);
+	SET_MISSING(actuals, 1);
+    }
+    PROTECT(actuals);
+    SEXP cell[nformals ? nformals : 1];
+    a = actuals;
+    for (int k = 0; k < nformals; k++, a = CDR(a))
+	cell[k] = a;
+
+    const int *map = INTEGER(VECTOR_ELT(entry, 1));
+    int i = 0;
+    for (b = supplied; b != R_NilValue; b = CDR(b), i++)
+	if (map[i] >= 0) {
+	    SETCAR(cell[map[i]], CAR(b));
+	    SET_MISSING(cell[map[i]], 0);
+	}
+	else ndots++;
+
+    int dots_i = map[n];
+    if (dots_i >= 0) {
+	SET_MISSING(cell[dots_i], 0);
+	if (ndots) {
+	    SEXP f = a = allocList(ndots);
+	    SET_TYPEOF(a, DOTSXP);
+	    i = 0;
+	    for (b = supplied; b != R_NilValue; b = CDR(b), i++)
+		if (map[i] < 0) {
+		    SETCAR(f, CAR(b));
+		    SET_TAG(f, TAG(b));
+		    f = CDR(f);
+		}
+	    SETCAR(cell[dots_i], a);
+	}
+    }
+    UNPROTECT(2);
+    return actuals;
+}
+
 /* We need to leave 'supplied' unchanged in case we call UseMethod */
 /* MULTIPLE_MATCHES was added by RI in Jan 2005 but never activated:
    code in R-2-8-branch */
@@ -185,9 +309,19 @@ attribute_hidden SEXP matchArgExact(SEXP tag, SEXP * list)
 attribute_hidden SEXP matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 {
     bool seendots;
-    int i, arg_i = 0;
+    int i, arg_i = 0, dots_i = -1;
     SEXP f, a, b, dots, actuals;
 
+    int nsupplied = 0;
+    int cache_h = argmatch_cacheable(formals, supplied, &nsupplied);
+    if (cache_h >= 0) {
+	SEXP entry = argmatch_lookup(cache_h, formals, supplied, nsupplied);
+	if (entry != NULL)
+	    return argmatch_replay(entry, formals, supplied, nsupplied);
+    }
+    /* for the cache: the formal matched by each supplied argument */
+    int smap[nsupplied ? nsupplied : 1];
+
     actuals = R_NilValue;
     for (f = formals ; f != R_NilValue ; f = CDR(f), arg_i++) {
 	/* CONS_NR is used since argument lists created here are only
@@ -239,6 +373,7 @@ attribute_hidden SEXP matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 		      if(CAR(b) != R_MissingArg) SET_MISSING(a, 0);
 		      SET_ARGUSED(b, 2);
 		      fargused[arg_i] = 2;
+		      if (cache_h >= 0) smap[i - 1] = arg_i;
 		  }
 	      }
 	    }
@@ -262,6 +397,7 @@ attribute_hidden SEXP matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 	    if (TAG(f) == R_DotsSymbol && !seendots) {
 		/* Record where ... value goes */
 		dots = a;
+		dots_i = arg_i;
 		seendots = TRUE;
 	    } else {
 		for (b = supplied, i = 1; b != R_NilValue; b = CDR(b), i++) {
@@ -287,6 +423,7 @@ attribute_hidden SEXP matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 			if (CAR(b) != R_MissingArg) SET_MISSING(a, 0);
 			SET_ARGUSED(b, 1);
 			fargused[arg_i] = 1;
+			if (cache_h >= 0) smap[i - 1] = arg_i;
 		    }
 		}
 	    }
@@ -307,6 +444,8 @@ attribute_hidden SEXP matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
     a = actuals;
     b = supplied;
     seendots = FALSE;
+    arg_i = 0;
+    i = 0;
 
     while (f != R_NilValue && b != R_NilValue && !seendots) {
 	if (TAG(f) == R_DotsSymbol) {
@@ -314,11 +453,13 @@ attribute_hidden SEXP matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 	    seendots = TRUE;
 	    f = CDR(f);
 	    a = CDR(a);
+	    arg_i++;
 	} else if (CAR(a) != R_MissingArg) {
 	    /* Already matched by tag */
 	    /* skip to next formal */
 	    f = CDR(f);
 	    a = CDR(a);
+	    arg_i++;
 	} else if (ARGUSED(b) || TAG(b) != R_NilValue) {
 	    /* This value used or tagged , skip to next value */
 	    /* The second test above is needed because we */
@@ -326,14 +467,18 @@ attribute_hidden SEXP matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 	    /* matches. */
 	    /* The formal being considered remains the same */
 	    b = CDR(b);
+	    i++;
 	} else {
 	    /* We have a positional match */
 	    SETCAR(a, CAR(b));
 	    if(CAR(b) != R_MissingArg) SET_MISSING(a, 0);
 	    SET_ARGUSED(b, 1);
+	    if (cache_h >= 0) smap[i] = arg_i;
 	    b = CDR(b);
 	    f = CDR(f);
 	    a = CDR(a);
+	    arg_i++;
+	    i++;
 	}
     }
 
@@ -382,6 +527,14 @@ attribute_hidden SEXP matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 		      strchr(CHAR(asChar(deparse1line(unused, 0))), '('));
 	}
     }
+
+    if (cache_h >= 0) {
+	i = 0;
+	for (b = supplied; b != R_NilValue; b = CDR(b), i++)
+	    if (! ARGUSED(b))
+		smap[i] = -1; /* in ... */
+	argmatch_store(cache_h, formals, supplied, nsupplied, smap, dots_i);
+    }
     UNPROTECT(1);
     return(actuals);
 }
@@ -89,6 +89,11 @@
 #include <Rmath.h> // R_pow_di
 #include <Print.h> // R_print
 
+#if defined(HAVE_MMAP) && !defined(Win32)
+# include <unistd.h>
+# include <sys/mman.h> /* for madvise */
+#endif
+
 /* malloc uses size_t.  We are assuming here that size_t is at least
    as large as unsigned long.  Changed from int at 1.6.0 to (i) allow
    2-4Gb objects on 32-bit system and (ii) objects limited only by
@@ -243,6 +248,21 @@ static void R_ReportAllocation(R_size_t);
 static void R_ReportNewPage(void);
 #endif
 
+/* bytes left to allocate until the next heap profile sample; 0 if not
+   sampling */
+static R_size_t R_HeapSampleLeft = 0;
+static void R_HeapSample(SEXP, R_size_t);
+static void R_PruneHeapSamples(void);
+
+#define HEAP_SAMPLE_ALLOC(s, bytes) do {		\
+	if (R_HeapSampleLeft) {				\
+	    if ((bytes) < R_HeapSampleLeft)		\
+		R_HeapSampleLeft -= (bytes);		\
+	    else					\
+		R_HeapSample(s, bytes);			\
+	}						\
+    } while (0)
+
 #define GC_PROT(X) do { \
     int __wait__ = gc_force_wait; \
     int __gap__ = gc_force_gap;			   \
@@ -281,7 +301,10 @@ static SEXPREC UnmarkedNodeTemplate;
    after every LEVEL_1_FREQ level 1 collections a level 2 collection
    occurs.  Thus, roughly, every LEVEL_0_FREQ-th collection is a level
    1 collection and every (LEVEL_0_FREQ * LEVEL_1_FREQ)-th collection
-   is a level 2 collection.  */
+   is a level 2 collection.  The frequencies can be set by the
+   environment variables R_GC_LEVEL_0_FREQ and R_GC_LEVEL_1_FREQ: on a
+   large heap of long-lived objects, a larger LEVEL_1_FREQ makes the
+   (expensive) full collections less frequent.  */
 #define LEVEL_0_FREQ 20
 #define LEVEL_1_FREQ 5
 static int collect_counts_max[] = { LEVEL_0_FREQ, LEVEL_1_FREQ };
@@ -402,6 +425,18 @@ static void init_gc_grow_settings(void)
 	if (0.05 <= frac && frac <= 0.80)
 	    R_VGrowIncrFrac = frac;
     }
+    arg = getenv("R_GC_LEVEL_0_FREQ");
+    if (arg != NULL) {
+	int freq = (int) atof(arg);
+	if (1 <= freq && freq <= 1000000)
+	    collect_counts_max[0] = freq;
+    }
+    arg = getenv("R_GC_LEVEL_1_FREQ");
+    if (arg != NULL) {
+	int freq = (int) atof(arg);
+	if (1 <= freq && freq <= 1000000)
+	    collect_counts_max[1] = freq;
+    }
 }
 
 /* Maximal Heap Limits.  These variables contain upper limits on the
@@ -701,6 +736,19 @@ static R_size_t R_NodesInUse = 0;
 #else
 #define FREE_FORWARD_CASE
 #endif
+/* Visiting the elements of a long list or character vector touches the
+   header of each element, usually a cache miss; prefetching the header
+   a few elements ahead lets these misses overlap. */
+#if defined(__GNUC__) || defined(__clang__)
+# define GC_PREFETCH_DIST 8
+# define GC_PREFETCH_ELT(x, i, n) do {					\
+	if ((i) + GC_PREFETCH_DIST < (n))				\
+	    __builtin_prefetch(VECTOR_ELT_0(x, (i) + GC_PREFETCH_DIST));	\
+    } while (0)
+#else
+# define GC_PREFETCH_ELT(x, i, n) do { } while (0)
+#endif
+
 /*** assume for now all ALTREP nodes are based on CONS nodes */
 #define DO_CHILDREN4(__n__,dc__action__,dc__str__action__,dc__extra__) do { \
   if (HAS_GENUINE_ATTRIB(__n__)) \
@@ -726,17 +774,21 @@ static R_size_t R_NodesInUse = 0;
     break; \
   case STRSXP: \
     { \
-      R_xlen_t i; \
-      for (i = 0; i < XLENGTH(__n__); i++) \
+      R_xlen_t i, __len__ = XLENGTH(__n__); \
+      for (i = 0; i < __len__; i++) { \
+	GC_PREFETCH_ELT(__n__, i, __len__); \
 	dc__str__action__(VECTOR_ELT_0(__n__, i), dc__extra__); \
+      } \
     } \
     break; \
   case EXPRSXP: \
   case VECSXP: \
     { \
-      R_xlen_t i; \
-      for (i = 0; i < XLENGTH(__n__); i++) \
+      R_xlen_t i, __len__ = XLENGTH(__n__); \
+      for (i = 0; i < __len__; i++) { \
+	GC_PREFETCH_ELT(__n__, i, __len__); \
 	dc__action__(VECTOR_ELT_0(__n__, i), dc__extra__); \
+      } \
     } \
     break; \
   case ENVSXP: \
@@ -1140,6 +1192,108 @@ static R_INLINE R_size_t getVecSizeInVEC(SEXP s)
 
 static void custom_node_free(void *ptr);
 
+/* Recycling of large vectors.  Large vectors are allocated by malloc,
+   which usually maps fresh pages from the OS for very large blocks and
+   unmaps them again on free: code repeatedly allocating and dropping
+   large temporaries then pays for page faults and zero-filling of
+   every page each time.  If the environment variable R_GC_LARGE_CACHE
+   is set to a number of megabytes, up to that amount of the memory of
+   freed vectors of at least LV_CACHE_MIN bytes is kept in a small
+   cache and reused for new vectors of the same size (up to 1/8
+   larger).  The cache is emptied if a malloc fails.
+
+   If R_GC_HUGEPAGES is true, the memory of vectors of at least
+   LV_HUGEPAGE_MIN bytes is marked with madvise(MADV_HUGEPAGE), where
+   supported, so transparent huge pages can be used for it. */
+#define LV_CACHE_SLOTS 16
+#define LV_CACHE_MIN (1024 * 1024)
+#define LV_HUGEPAGE_MIN (4 * 1024 * 1024)
+
+static struct {
+    void *mem;
+    R_size_t size; /* bytes usable, including the header */
+} lv_cache[LV_CACHE_SLOTS];
+static int lv_cache_count = 0;
+static R_size_t lv_cache_bytes = 0, lv_cache_max = 0;
+static Rboolean lv_hugepages = FALSE;
+
+static void init_gc_large_settings(void)
+{
+    char *arg = getenv("R_GC_LARGE_CACHE");
+    if (arg != NULL) {
+	double mb = atof(arg);
+	if (0 < mb && mb <= 1048576) /* up to 1Tb */
+	    lv_cache_max = (R_size_t) (mb * Mega);
+    }
+    arg = getenv("R_GC_HUGEPAGES");
+    if (arg != NULL && StringTrue(arg))
+	lv_hugepages = TRUE;
+}
+
+static void *lv_cache_get(R_size_t bytes)
+{
+    for (int i = lv_cache_count - 1; i >= 0; i--)
+	if (lv_cache[i].size >= bytes &&
+	    lv_cache[i].size - bytes <= bytes / 8) {
+	    void *mem = lv_cache[i].mem;
+	    lv_cache_bytes -= lv_cache[i].size;
+	    lv_cache_count--;
+	    for (int j = i; j < lv_cache_count; j++)
+		lv_cache[j] = lv_cache[j + 1];
+	    return mem;
+	}
+    return NULL;
+}
+
+/* returns TRUE if mem has been kept, evicting the oldest entries if
+   needed */
+static Rboolean lv_cache_put(void *mem, R_size_t bytes)
+{
+    if (bytes < LV_CACHE_MIN || bytes > lv_cache_max)
+	return FALSE;
+    while (lv_cache_count > 0 &&
+	   (lv_cache_count == LV_CACHE_SLOTS ||
+	    lv_cache_bytes + bytes > lv_cache_max)) {
+	free(lv_cache[0].mem);
+	lv_cache_bytes -= lv_cache[0].size;
+	lv_cache_count--;
+	for (int j = 0; j < lv_cache_count; j++)
+	    lv_cache[j] = lv_cache[j + 1];
+    }
+    lv_cache[lv_cache_count].mem = mem;
+    lv_cache[lv_cache_count].size = bytes;
+    lv_cache_count++;
+    lv_cache_bytes += bytes;
+    return TRUE;
+}
+
+static void lv_cache_clear(void)
+{
+    for (int i = 0; i < lv_cache_count; i++)
+	free(lv_cache[i].mem);
+    lv_cache_count = 0;
+    lv_cache_bytes = 0;
+}
+
+static void *large_vector_malloc(R_size_t bytes)
+{
+    void *mem = lv_cache_get(bytes);
+    if (mem == NULL) {
+	mem = malloc(bytes);
+#if defined(HAVE_MMAP) && !defined(Win32) && defined(MADV_HUGEPAGE)
+	if (mem != NULL && lv_hugepages && bytes >= LV_HUGEPAGE_MIN) {
+	    /* the whole pages inside the block */
+	    uintptr_t pgsz = (uintptr_t) sysconf(_SC_PAGESIZE),
+		start = ((uintptr_t) mem + pgsz - 1) & ~(pgsz - 1),
+		end = ((uintptr_t) mem + bytes) & ~(pgsz - 1);
+	    if (end > start)
+		madvise((void *) start, end - start, MADV_HUGEPAGE);
+	}
+#endif
+    }
+    return mem;
+}
+
 static void ReleaseLargeFreeVectors(void)
 {
     for (int node_class = CUSTOM_NODE_CLASS; node_class <= LARGE_NODE_CLASS; node_class++) {
@@ -1164,7 +1318,9 @@ static void ReleaseLargeFreeVectors(void)
 		R_GenHeap[node_class].AllocCount--;
 		if (node_class == LARGE_NODE_CLASS) {
 		    R_LargeVallocSize -= size;
-		    free(s);
+		    if (! lv_cache_put(s, sizeof(SEXPREC_ALIGN) +
+				       size * sizeof(VECREC)))
+			free(s);
 		} else {
 		    custom_node_free(s);
 		}
@@ -1904,6 +2060,9 @@ static int RunGenCollect(R_size_t size_needed)
     FORWARD_AND_PROCESS_ONE_NODE(R_StringHash, VECSXP);
     PROCESS_NODES(); /* probably nothing to process, but just in case ... */
 
+    /* forget heap profile samples of unreachable vectors */
+    R_PruneHeapSamples();
+
 #ifdef PROTECTCHECK
     for(i=0; i< NUM_SMALL_NODE_CLASSES;i++){
 	s = NEXT_NODE(R_GenHeap[i].New);
@@ -2104,6 +2263,34 @@ attribute_hidden SEXP do_gcinfo(SEXP call, SEXP op, SEXP args, SEXP rho)
     return old;
 }
 
+/* .Internal(gcstats()): the numbers of collections at each level, the
+   collection frequencies and the numbers of nodes in each old
+   generation as of the end of the last collection. */
+attribute_hidden SEXP do_gcstats(SEXP call, SEXP op, SEXP args, SEXP rho)
+{
+    checkArity(op, args);
+    const char *nms[] = {"collections", "frequencies", "nodes", ""};
+    SEXP ans = PROTECT(mkNamed(VECSXP, nms));
+    SEXP counts = allocVector(INTSXP, NUM_OLD_GENERATIONS + 1);
+    SET_VECTOR_ELT(ans, 0, counts);
+    for (int level = 0; level <= NUM_OLD_GENERATIONS; level++)
+	INTEGER(counts)[level] = gen_gc_counts[level];
+    SEXP freqs = allocVector(INTSXP, NUM_OLD_GENERATIONS);
+    SET_VECTOR_ELT(ans, 1, freqs);
+    for (int level = 0; level < NUM_OLD_GENERATIONS; level++)
+	INTEGER(freqs)[level] = collect_counts_max[level];
+    SEXP nodes = allocVector(REALSXP, NUM_OLD_GENERATIONS);
+    SET_VECTOR_ELT(ans, 2, nodes);
+    for (int gen = 0; gen < NUM_OLD_GENERATIONS; gen++) {
+	double n = 0;
+	for (int i = 0; i < NUM_NODE_CLASSES; i++)
+	    n += R_GenHeap[i].OldCount[gen];
+	REAL(nodes)[gen] = n;
+    }
+    UNPROTECT(1);
+    return ans;
+}
+
 /* reports memory use to profiler in eval.c */
 
 attribute_hidden void get_current_mem(size_t *smallvsize,
@@ -2210,6 +2397,7 @@ attribute_hidden void InitMemory(void)
 
     init_gctorture();
     init_gc_grow_settings();
+    init_gc_large_settings();
 
     arg = getenv("_R_GC_FAIL_ON_ERROR_");
     if (arg != NULL && StringTrue(arg))
@@ -2734,6 +2922,7 @@ SEXP allocVector3(SEXPTYPE type, R_xlen_t length, R_allocator_t *allocator)
 	    SET_STDVEC_LENGTH(s, (R_len_t) length); // is 1
 	    SET_STDVEC_TRUELENGTH(s, 0);
 	    INIT_REFCNT(s);
+	    HEAP_SAMPLE_ALLOC(s, alloc_size * sizeof(VECREC));
 	    return(s);
 	}
     }
@@ -2891,15 +3080,16 @@ SEXP allocVector3(SEXPTYPE type, R_xlen_t length, R_allocator_t *allocator)
 		   indexable by size_t. - TK */
 		mem = allocator ?
 		    custom_node_alloc(allocator, hdrsize + size * sizeof(VECREC)) :
-		    malloc(hdrsize + size * sizeof(VECREC));
+		    large_vector_malloc(hdrsize + size * sizeof(VECREC));
 		if (mem == NULL) {
 		    /* If we are near the address space limit, we
 		       might be short of address space.  So return
 		       all unused objects to malloc and try again. */
 		    R_gc_no_finalizers(alloc_size);
+		    lv_cache_clear();
 		    mem = allocator ?
 			custom_node_alloc(allocator, hdrsize + size * sizeof(VECREC)) :
-			malloc(hdrsize + size * sizeof(VECREC));
+			large_vector_malloc(hdrsize + size * sizeof(VECREC));
 		}
 		if (mem != NULL) {
 		    s = mem;
@@ -2985,6 +3175,8 @@ SEXP allocVector3(SEXPTYPE type, R_xlen_t length, R_allocator_t *allocator)
     else if (type == RAWSXP)
 	VALGRIND_MAKE_MEM_UNDEFINED(RAW(s), actual_size);
 #endif
+    if (size > 0)
+	HEAP_SAMPLE_ALLOC(s, size * sizeof(VECREC));
     return s;
 }
 
@@ -4918,6 +5110,231 @@ SEXP do_Rprofmem(SEXP args)
 
 #endif /* R_MEMORY_PROFILING */
 
+/*******************************************/
+/* Sampling heap profiler: samples vector  */
+/* allocations about every 'interval'      */
+/* bytes and aggregates them by call stack */
+/*******************************************/
+
+typedef struct {
+    char *stack;
+    unsigned int hash;
+    double samples, live_samples;
+} HeapSite;
+
+typedef struct {
+    SEXP obj;	/* not protected: dropped when it is collected */
+    int site;
+    double n;	/* number of samples it accounts for */
+} HeapSample;
+
+static double heap_interval = 0;
+static int heap_depth = 20;
+static HeapSite *heap_sites = NULL;
+static int heap_nsites = 0, heap_sites_size = 0;
+static int *heap_site_tab = NULL; /* hash table of site indices, -1 if empty */
+static int heap_tab_size = 0;     /* a power of 2 */
+static HeapSample *heap_samples = NULL;
+static int heap_nsamples = 0, heap_samples_size = 0;
+static uint64_t heap_rng = 88172645463325252ULL;
+
+/* exponentially distributed with mean heap_interval, using a private
+   xorshift generator so as not to disturb the user's RNG */
+static R_size_t heap_next_interval(void)
+{
+    heap_rng ^= heap_rng << 13;
+    heap_rng ^= heap_rng >> 7;
+    heap_rng ^= heap_rng << 17;
+    double u = ((double) (heap_rng >> 11) + 0.5) / 9007199254740992.0;
+    double d = -log(u) * heap_interval;
+    return d < 1 ? 1 : (R_size_t) d;
+}
+
+static void heap_reset(void)
+{
+    for (int i = 0; i < heap_nsites; i++)
+	free(heap_sites[i].stack);
+    free(heap_sites);
+    free(heap_site_tab);
+    free(heap_samples);
+    heap_sites = NULL;
+    heap_site_tab = NULL;
+    heap_samples = NULL;
+    heap_nsites = heap_sites_size = heap_tab_size = 0;
+    heap_nsamples = heap_samples_size = 0;
+}
+
+static Rboolean heap_grow_tab(void)
+{
+    int size = heap_tab_size ? 2 * heap_tab_size : 256;
+    int *tab = malloc(size * sizeof(int));
+    if (tab == NULL) return FALSE;
+    for (int i = 0; i < size; i++) tab[i] = -1;
+    for (int i = 0; i < heap_nsites; i++) {
+	int j = heap_sites[i].hash & (size - 1);
+	while (tab[j] >= 0) j = (j + 1) & (size - 1);
+	tab[j] = i;
+    }
+    free(heap_site_tab);
+    heap_site_tab = tab;
+    heap_tab_size = size;
+    return TRUE;
+}
+
+/* the index of the site of the current call stack, -1 if it cannot be
+   recorded.  Must not allocate on the R heap. */
+static int heap_site(void)
+{
+    char buf[8192];
+    size_t len = 0;
+    int depth = 0;
+
+    buf[0] = '\0';
+    for (RCNTXT *cptr = R_GlobalContext;
+	 cptr && depth < heap_depth; cptr = cptr->nextcontext)
+	if ((cptr->callflag & (CTXT_FUNCTION | CTXT_BUILTIN))
+	    && TYPEOF(cptr->call) == LANGSXP) {
+	    SEXP fun = CAR(cptr->call);
+	    int k = snprintf(buf + len, sizeof(buf) - len, "%s\"%s\"",
+			     depth ? " " : "",
+			     TYPEOF(fun) == SYMSXP ? CHAR(PRINTNAME(fun)) :
+			     "<Anonymous>");
+	    if (k < 0 || len + k >= sizeof(buf)) {
+		buf[len] = '\0';
+		break;
+	    }
+	    len += k;
+	    depth++;
+	}
+
+    unsigned int h = 2166136261U; /* FNV-1a */
+    for (size_t i = 0; i < len; i++)
+	h = (h ^ (unsigned char) buf[i]) * 16777619U;
+
+    if (2 * (heap_nsites + 1) > heap_tab_size && ! heap_grow_tab())
+	return -1;
+    int j = h & (heap_tab_size - 1);
+    for (; heap_site_tab[j] >= 0; j = (j + 1) & (heap_tab_size - 1)) {
+	HeapSite *site = heap_sites + heap_site_tab[j];
+	if (site->hash == h && strcmp(site->stack, buf) == 0)
+	    return heap_site_tab[j];
+    }
+
+    if (heap_nsites == heap_sites_size) {
+	int size = heap_sites_size ? 2 * heap_sites_size : 128;
+	HeapSite *sites = realloc(heap_sites, size * sizeof(HeapSite));
+	if (sites == NULL) return -1;
+	heap_sites = sites;
+	heap_sites_size = size;
+    }
+    char *stack = strdup(buf);
+    if (stack == NULL) return -1;
+    HeapSite *site = heap_sites + heap_nsites;
+    site->stack = stack;
+    site->hash = h;
+    site->samples = site->live_samples = 0;
+    heap_site_tab[j] = heap_nsites;
+    return heap_nsites++;
+}
+
+/* called from allocVector3 when the allocation of 'bytes' for 's'
+   reaches the next sample point */
+static void R_HeapSample(SEXP s, R_size_t bytes)
+{
+    R_size_t rest = bytes - R_HeapSampleLeft;
+    double n = 1;
+    if (rest > 64 * heap_interval) {
+	n += floor(rest / heap_interval);
+	R_HeapSampleLeft = heap_next_interval();
+    } else {
+	R_HeapSampleLeft = heap_next_interval();
+	while (rest >= R_HeapSampleLeft) {
+	    rest -= R_HeapSampleLeft;
+	    R_HeapSampleLeft = heap_next_interval();
+	    n++;
+	}
+	R_HeapSampleLeft -= rest;
+    }
+
+    int site = heap_site();
+    if (site < 0) return;
+    heap_sites[site].samples += n;
+
+    if (heap_nsamples == heap_samples_size) {
+	int size = heap_samples_size ? 2 * heap_samples_size : 1024;
+	HeapSample *samples =
+	    realloc(heap_samples, size * sizeof(HeapSample));
+	if (samples == NULL) return;
+	heap_samples = samples;
+	heap_samples_size = size;
+    }
+    heap_samples[heap_nsamples].obj = s;
+    heap_samples[heap_nsamples].site = site;
+    heap_samples[heap_nsamples].n = n;
+    heap_nsamples++;
+}
+
+/* called by the collector after marking: nodes of all generations
+   which survive are marked at this point */
+static void R_PruneHeapSamples(void)
+{
+    if (heap_nsites == 0) return;
+    for (int i = 0; i < heap_nsites; i++)
+	heap_sites[i].live_samples = 0;
+    int k = 0;
+    for (int i = 0; i < heap_nsamples; i++)
+	if (NODE_IS_MARKED(heap_samples[i].obj)) {
+	    heap_sites[heap_samples[i].site].live_samples += heap_samples[i].n;
+	    heap_samples[k++] = heap_samples[i];
+	}
+    heap_nsamples = k;
+}
+
+SEXP do_Rprofheap(SEXP args)
+{
+    double interval = asReal(CAR(args));
+    int depth = asInteger(CADR(args));
+    if (!R_FINITE(interval) || interval < 0)
+	error(_("invalid '%s' argument"), "interval");
+    if (depth == NA_INTEGER || depth < 1)
+	error(_("invalid '%s' argument"), "depth");
+    if (interval > 0) {
+	heap_reset();
+	heap_interval = interval;
+	heap_depth = depth;
+	R_HeapSampleLeft = heap_next_interval();
+    } else
+	R_HeapSampleLeft = 0;
+    return R_NilValue;
+}
+
+SEXP do_Rprofheapsummary(SEXP args)
+{
+    /* sampling may add sites while this allocates */
+    int n = heap_nsites;
+    const char *names[] = {"stack", "samples", "bytes", "live.samples",
+			   "live.bytes", ""};
+    SEXP ans = PROTECT(mkNamed(VECSXP, names));
+    SEXP stack = allocVector(STRSXP, n);
+    SET_VECTOR_ELT(ans, 0, stack);
+    for (int j = 1; j < 5; j++)
+	SET_VECTOR_ELT(ans, j, allocVector(REALSXP, n));
+    double *samples = REAL(VECTOR_ELT(ans, 1)),
+	*bytes = REAL(VECTOR_ELT(ans, 2)),
+	*live = REAL(VECTOR_ELT(ans, 3)),
+	*live_bytes = REAL(VECTOR_ELT(ans, 4));
+    for (int i = 0; i < n; i++) {
+	samples[i] = heap_sites[i].samples;
+	bytes[i] = heap_sites[i].samples * heap_interval;
+	live[i] = heap_sites[i].live_samples;
+	live_bytes[i] = heap_sites[i].live_samples * heap_interval;
+    }
+    for (int i = 0; i < n; i++)
+	SET_STRING_ELT(stack, i, mkChar(heap_sites[i].stack));
+    UNPROTECT(1);
+    return ans;
+}
+
 /* RBufferUtils, moved from deparse.c */
 
 #include "RBufferUtils.h"
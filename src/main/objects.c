@@ -167,10 +167,17 @@ void R_warn_S3_for_S4(SEXP method) {
 }
 #endif
 
-static SEXP findFunInEnvRange(SEXP symbol, SEXP rho, SEXP target)
+/* Search the frames from rho up to, but not including, target.  Sets
+   *reached to whether target was met before the empty environment. */
+static SEXP findFunInEnvRange(SEXP symbol, SEXP rho, SEXP target,
+			      Rboolean *reached)
 {
     SEXP vl;
     while(rho != R_EmptyEnv) {
+	if(rho == target) {
+	    *reached = TRUE;
+	    return (R_UnboundValue);
+	}
 	vl = R_findVarInFrame(rho, symbol);
 	if (vl != R_UnboundValue) {
 	    if (TYPEOF(vl) == PROMSXP) {
@@ -183,36 +190,158 @@ static SEXP findFunInEnvRange(SEXP symbol, SEXP rho, SEXP target)
 		 TYPEOF(vl) == SPECIALSXP))
 		return (vl);
 	}
-	if(rho == target)
-	    return (R_UnboundValue);
-	else
-	    rho = ENCLOS(rho);
+	rho = ENCLOS(rho);
     }
+    *reached = FALSE;
     return (R_UnboundValue);
 }
 
-static SEXP findFunWithBaseEnvAfterGlobalEnv(SEXP symbol, SEXP rho)
+/* Cache for the part of the search in R_LookupMethod which starts at
+   the top level environment 'top' of the call: the frame of 'top', the
+   S3 methods table of the defining environment 'defrho' and the
+   environments from the enclosure of 'top' on (with the base
+   environment after the global one).  This part depends only on
+   (method, top, defrho) and is most of the cost of a dispatch when the
+   method is registered or not found at all, as for each class in turn
+   before reaching the default method.
+
+   An entry holds the binding cell in which the method was found, or
+   R_NilValue if there was none.  The value is read from the cell on
+   each hit, so assigning to an existing binding needs no invalidation.
+   The frames searched are marked, and creating or removing a binding
+   in a marked frame, attaching or detaching, or changing an enclosure
+   increments R_S3MethodsEpoch, which invalidates all entries.  Searches
+   which pass a non-function binding, an active binding or a user
+   database are not cached. */
+
+#define S3_METHODS_CACHE_SIZE 1024
+
+#define IS_USER_DATABASE(rho)  (OBJECT((rho)) && inherits((rho), "UserDefinedDatabase"))
+
+static SEXP S3MethodsCache = NULL;
+static unsigned int S3MethodsCacheEpoch[S3_METHODS_CACHE_SIZE];
+
+static R_INLINE int S3MethodsCacheIndex(SEXP method, SEXP top, SEXP defrho)
+{
+    uintptr_t h = (uintptr_t) method >> 4;
+    h = h * 31 + ((uintptr_t) top >> 4);
+    h = h * 31 + ((uintptr_t) defrho >> 4);
+    return (int) (h % S3_METHODS_CACHE_SIZE);
+}
+
+/* The function bound in a cached cell, or NULL if the binding no
+   longer holds one the search could return without evaluation. */
+static R_INLINE SEXP S3MethodsCacheValue(SEXP cell)
+{
+    SEXP val;
+    if (IS_ACTIVE_BINDING(cell))
+	return NULL;
+    if (TYPEOF(cell) == SYMSXP)
+	val = SYMVALUE(cell);
+    else if (BNDCELL_TAG(cell))
+	return NULL;
+    else
+	val = CAR0(cell);
+    if (TYPEOF(val) == PROMSXP) {
+	if (! PROMISE_IS_EVALUATED(val))
+	    return NULL;
+	val = PRVALUE(val);
+    }
+    switch (TYPEOF(val)) {
+    case CLOSXP:
+    case BUILTINSXP:
+    case SPECIALSXP:
+	return val;
+    default:
+	return NULL;
+    }
+}
+
+/* Look up a method in the frame of 'env', evaluating a promise in
+   'penv'.  Unless 'anyval' is true only functions are returned.  If
+   '*pcell' is not NULL it is set to the binding of the value returned,
+   or to NULL if the frame holds a binding which the cache can neither
+   use nor skip. */
+static SEXP findS3MethodInFrame(SEXP method, SEXP env, SEXP penv,
+				Rboolean anyval, SEXP *pcell)
 {
+    R_varloc_t loc;
     SEXP vl;
-    while(rho != R_EmptyEnv) {
-	vl = R_findVarInFrame(rho, symbol);
-	if (vl != R_UnboundValue) {
-	    if (TYPEOF(vl) == PROMSXP) {
-		PROTECT(vl);
-		vl = eval(vl, rho);
-		UNPROTECT(1);
-	    }
-	    if ((TYPEOF(vl) == CLOSXP ||
-		 TYPEOF(vl) == BUILTINSXP ||
-		 TYPEOF(vl) == SPECIALSXP))
-		return (vl);
-	}
-	if(rho == R_GlobalEnv)
-	    rho = R_BaseEnv;
-	else
-	    rho = ENCLOS(rho);
+
+    MARK_AS_S3_LOOKUP_FRAME(env);
+    if (IS_USER_DATABASE(env)) {
+	*pcell = NULL;
+	vl = R_findVarInFrame(env, method);
+	loc.cell = NULL;
     }
-    return (R_UnboundValue);
+    else {
+	loc = R_findVarLocInFrame(env, method);
+	if (loc.cell == NULL)
+	    return R_UnboundValue;
+	if (IS_ACTIVE_BINDING(loc.cell))
+	    *pcell = NULL;
+	vl = R_GetVarLocValue(loc);
+    }
+    if (vl == R_UnboundValue)
+	return vl;
+    if (TYPEOF(vl) == PROMSXP) {
+	PROTECT(vl);
+	vl = eval(vl, penv);
+	UNPROTECT(1);
+    }
+    if (anyval ||
+	TYPEOF(vl) == CLOSXP ||
+	TYPEOF(vl) == BUILTINSXP ||
+	TYPEOF(vl) == SPECIALSXP) {
+	if (*pcell != NULL)
+	    *pcell = loc.cell;
+	return vl;
+    }
+    *pcell = NULL;
+    return R_UnboundValue;
+}
+
+/* The search from 'top' on, the frame of 'top' itself only if
+   'searchtop' is true. */
+static SEXP findS3MethodFromTop(SEXP method, SEXP rho, SEXP top,
+				SEXP defrho, Rboolean searchtop,
+				SEXP *pcell)
+{
+    static SEXP s_S3MethodsTable = NULL;
+    SEXP val;
+
+    if (searchtop) {
+	val = findS3MethodInFrame(method, top, top, FALSE, pcell);
+	if (val != R_UnboundValue)
+	    return val;
+    }
+
+    /* We assume here that no one registered a non-function */
+    if (!s_S3MethodsTable)
+	s_S3MethodsTable = install(".__S3MethodsTable__.");
+    MARK_AS_S3_LOOKUP_FRAME(defrho);
+    SEXP table = R_findVarInFrame(defrho, s_S3MethodsTable);
+    if (TYPEOF(table) == PROMSXP) {
+	PROTECT(table);
+	table = eval(table, R_BaseEnv);
+	UNPROTECT(1); /* table */
+    }
+    if (TYPEOF(table) == ENVSXP) {
+	PROTECT(table);
+	val = findS3MethodInFrame(method, table, rho, TRUE, pcell);
+	UNPROTECT(1); /* table */
+	if (val != R_UnboundValue)
+	    return val;
+    }
+
+    SEXP env = (top == R_GlobalEnv) ? R_BaseEnv : ENCLOS(top);
+    while (env != R_EmptyEnv) {
+	val = findS3MethodInFrame(method, env, env, FALSE, pcell);
+	if (val != R_UnboundValue)
+	    return val;
+	env = (env == R_GlobalEnv) ? R_BaseEnv : ENCLOS(env);
+    }
+    return R_UnboundValue;
 }
 
 /*  usemethod  -  calling functions need to evaluate the object
@@ -234,8 +363,6 @@ attribute_hidden
 SEXP R_LookupMethod(SEXP method, SEXP rho, SEXP callrho, SEXP defrho)
 {
     SEXP val, top = R_NilValue;	/* -Wall */
-    static SEXP s_S3MethodsTable = NULL;
-    PROTECT_INDEX validx;
 
     if (TYPEOF(callrho) != ENVSXP) {
 	if (TYPEOF(callrho) == NILSXP)
@@ -254,40 +381,50 @@ SEXP R_LookupMethod(SEXP method, SEXP rho, SEXP callrho, SEXP defrho)
 
     /* This evaluates promises */
     PROTECT(top = topenv(R_NilValue, callrho));
-    val = findFunInEnvRange(method, callrho, top);
+    Rboolean reached = FALSE;
+    val = findFunInEnvRange(method, callrho, top, &reached);
     if(val != R_UnboundValue) {
 	UNPROTECT(1); /* top */
 	return val;
     }
 
-    PROTECT_WITH_INDEX(val, &validx);
-    /* We assume here that no one registered a non-function */
-    if (!s_S3MethodsTable)
-	s_S3MethodsTable = install(".__S3MethodsTable__.");
-    SEXP table = R_findVarInFrame(defrho, s_S3MethodsTable);
-    if (TYPEOF(table) == PROMSXP) {
-	PROTECT(table);
-	table = eval(table, R_BaseEnv);
-	UNPROTECT(1); /* table */
-    }
-    if (TYPEOF(table) == ENVSXP) {
-	PROTECT(table);
-	REPROTECT(val = R_findVarInFrame(table, method), validx);
-	UNPROTECT(1); /* table */
-	if (TYPEOF(val) == PROMSXP) 
-	    REPROTECT(val = eval(val, rho), validx);
-	if(val != R_UnboundValue) {
-	    UNPROTECT(2); /* top, val */
-	    return val;
+    /* 'top' is not searched if it is not an enclosure of 'callrho',
+       and such searches are not cached */
+    SEXP cell = NULL;
+    int i = 0;
+    if (reached) {
+	if (S3MethodsCache == NULL) {
+	    S3MethodsCache = allocVector(VECSXP, 4 * S3_METHODS_CACHE_SIZE);
+	    R_PreserveObject(S3MethodsCache);
 	}
-    } 
+	i = S3MethodsCacheIndex(method, top, defrho);
+	if (S3MethodsCacheEpoch[i] == R_S3MethodsEpoch &&
+	    VECTOR_ELT(S3MethodsCache, 4 * i) == method &&
+	    VECTOR_ELT(S3MethodsCache, 4 * i + 1) == top &&
+	    VECTOR_ELT(S3MethodsCache, 4 * i + 2) == defrho) {
+	    cell = VECTOR_ELT(S3MethodsCache, 4 * i + 3);
+	    val = cell == R_NilValue ? R_UnboundValue :
+		S3MethodsCacheValue(cell);
+	    if (val != NULL) {
+		UNPROTECT(1); /* top */
+		return val;
+	    }
+	}
+	cell = R_NilValue;
+    }
 
-    if (top == R_GlobalEnv)
-	top = R_BaseEnv;
-    else
-	top = ENCLOS(top);
-    REPROTECT(val = findFunWithBaseEnvAfterGlobalEnv(method, top),
-	      validx);
+    /* evaluating promises in the search may change the environments
+       searched, in which case the result is not cached */
+    unsigned int epoch = R_S3MethodsEpoch;
+    PROTECT(val = findS3MethodFromTop(method, rho, top, defrho, reached,
+				      &cell));
+    if (cell != NULL && epoch == R_S3MethodsEpoch) {
+	S3MethodsCacheEpoch[i] = epoch;
+	SET_VECTOR_ELT(S3MethodsCache, 4 * i, method);
+	SET_VECTOR_ELT(S3MethodsCache, 4 * i + 1, top);
+	SET_VECTOR_ELT(S3MethodsCache, 4 * i + 2, defrho);
+	SET_VECTOR_ELT(S3MethodsCache, 4 * i + 3, cell);
+    }
 
     UNPROTECT(2); /* top, val */
     return val;
@@ -65,6 +65,7 @@
  *	"paper.size"		./devPS.c
 
  *	"timeout"		./connections.c
+ *	"compress.threads"	./connections.c
 
  *      "deparse.max.lines"     ./deparse.c (& PrintCall() in ./eval.c, ./main.c
 
@@ -81,6 +82,7 @@
  *	"browserNLdisabled"
 
  *	"matprod"
+ *	"match.cache"		./unique.c
  *      "PCRE_study"
  *      "PCRE_use_JIT"
 
@@ -303,9 +305,9 @@ attribute_hidden void InitOptions(void)
 
     /* options set here should be included into mandatory[] in do_options */
 #ifdef HAVE_RL_COMPLETION_MATCHES
-    PROTECT(v = val = allocList(31));
+    PROTECT(v = val = allocList(33));
 #else
-    PROTECT(v = val = allocList(30));
+    PROTECT(v = val = allocList(32));
 #endif
 
     SET_TAG(v, install("prompt"));
@@ -397,6 +399,14 @@ attribute_hidden void InitOptions(void)
     SETCAR(v, mkString(p));
     v = CDR(v);
 
+    SET_TAG(v, install("match.cache"));
+    SETCAR(v, ScalarInteger(R_MatchCacheSize));
+    v = CDR(v);
+
+    SET_TAG(v, install("compress.threads"));
+    SETCAR(v, ScalarInteger(1));
+    v = CDR(v);
+
     SET_TAG(v, install("PCRE_study"));
     if (R_PCRE_study == -1)
 	SETCAR(v, ScalarLogical(TRUE));
@@ -590,7 +600,8 @@ attribute_hidden SEXP do_options(SEXP call, SEXP op, SEXP args, SEXP rho)
 		  "check.bounds", "keep.source", "keep.source.pkgs",
 		  "keep.parse.data", "keep.parse.data.pkgs", "warning.length",
 		  "nwarnings", "OutDec", "CBoundsCheck",
-		  "matprod", "PCRE_study", "PCRE_use_JIT",
+		  "matprod", "match.cache", "compress.threads",
+		  "PCRE_study", "PCRE_use_JIT",
 		  "PCRE_limit_recursion", "rl_word_breaks",
 		  "max.contour.segments", "warnPartialMatchDollar",
 		  "warnPartialMatchArgs", "warnPartialMatchAttr",
@@ -843,6 +854,14 @@ attribute_hidden SEXP do_options(SEXP call, SEXP op, SEXP args, SEXP rho)
 		    error(_("invalid value for '%s'"), CHAR(namei));
 		SET_VECTOR_ELT(value, i, SetOption(tag, duplicate(argi)));
 	    }
+	    else if (streql(CHAR(namei), "match.cache")) {
+		int k = asInteger(argi);
+		if (k == NA_INTEGER || k < 0)
+		    error(_("invalid value for '%s'"), CHAR(namei));
+		R_MatchCacheSize = k;
+		R_TrimMatchCache();
+		SET_VECTOR_ELT(value, i, SetOption(tag, ScalarInteger(k)));
+	    }
 	    else if (streql(CHAR(namei), "PCRE_study")) {
 		if (TYPEOF(argi) == LGLSXP) {
 		    int k = asLogical(argi) > 0;
@@ -427,6 +427,82 @@ static void alloc_xtmp(int n)
     xtmp_alloc = n;
 }
 
+/* Multi-threaded version of the first pass of iradix() and dradix()
+   over all n keys, used for long vectors when math threads are enabled
+   (see R_par_nthreads).  The keys are split into one contiguous block
+   per thread.  par_radixcounts() histograms the bytes of each block
+   separately and sums the counts into radixcounts.  par_radixscatter()
+   then places the elements of each block after those of the preceding
+   blocks with the same byte value, so the ordering is exactly that
+   given by the serial pass, which is stable. */
+typedef unsigned long long (*radixkey_t) (void *, int);
+
+static unsigned int *par_counts = NULL; // [nth][8][256]
+static int par_counts_alloc = 0;
+
+#define PAR_COUNTS(t, radix) (par_counts + ((t) * 8 + (radix)) * 256)
+#define PAR_BLOCK_START(t, nth, n) ((int) ((R_xlen_t) (n) * (t) / (nth)))
+
+static void par_radixcounts(void *x, int n, radixkey_t key, int nbytes,
+			    int nth)
+{
+    if (par_counts_alloc < nth) {
+	par_counts = (unsigned int *)
+	    realloc(par_counts, nth * 8 * 256 * sizeof(unsigned int));
+	if (par_counts == NULL)
+	    Error("Failed to allocate working memory for par_counts. Requested %d * %d bytes",
+		  nth * 8 * 256, (int)sizeof(unsigned int));
+	par_counts_alloc = nth;
+    }
+    memset(par_counts, 0, nth * 8 * 256 * sizeof(unsigned int));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) schedule(static)
+#endif
+    for (int t = 0; t < nth; t++) {
+	int hi = PAR_BLOCK_START(t + 1, nth, n);
+	for (int i = PAR_BLOCK_START(t, nth, n); i < hi; i++) {
+	    unsigned long long thisx = key(x, i);
+	    for (int radix = 0; radix < nbytes; radix++)
+		PAR_COUNTS(t, radix)[thisx >> (radix * 8) & 0xFF]++;
+	}
+    }
+    for (int t = 0; t < nth; t++)
+	for (int radix = 0; radix < nbytes; radix++)
+	    for (int i = 0; i < 256; i++)
+		radixcounts[radix][i] += PAR_COUNTS(t, radix)[i];
+}
+
+/* thiscounts are the cumulated counts for 'radix', as for the serial
+   pass, and are left as that pass leaves them. */
+static void par_radixscatter(void *x, int *o, int n, radixkey_t key,
+			     int radix, int nth, unsigned int *thiscounts)
+{
+    // turn the block counts into each block's starting positions
+    for (int i = 0; i < 256; i++) {
+	unsigned int pos = thiscounts[i];
+	for (int t = nth - 1; t >= 0; t--) {
+	    pos -= PAR_COUNTS(t, radix)[i];
+	    PAR_COUNTS(t, radix)[i] = pos;
+	}
+	thiscounts[i] = pos;
+    }
+    int shift = radix * 8;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) schedule(static)
+#endif
+    for (int t = 0; t < nth; t++) {
+	unsigned int *pos = PAR_COUNTS(t, radix);
+	int hi = PAR_BLOCK_START(t + 1, nth, n);
+	for (int i = PAR_BLOCK_START(t, nth, n); i < hi; i++)
+	    o[pos[key(x, i) >> shift & 0xFF]++] = i + 1;
+    }
+}
+
+static unsigned long long ikey(void *x, int i)
+{
+    return (unsigned int) (icheck(((int *) x)[i])) - INT_MIN;
+}
+
 static void iradix_r(int *xsub, int *osub, int n, int radix);
 
 static void iradix(int *x, int *o, int n)
@@ -437,8 +513,13 @@ static void iradix(int *x, int *o, int n)
 {
     int nextradix, itmp, thisgrpn, maxgrpn;
     unsigned int thisx = 0, shift, *thiscounts;
+    int nth = R_par_nthreads(n);
 
-    for (int i = 0; i < n;i++) {
+    if (nth > 1) {
+	par_radixcounts(x, n, ikey, 4, nth);
+	thisx = (unsigned int) ikey(x, n - 1);
+    }
+    else for (int i = 0; i < n;i++) {
 	/* parallel histogramming pass; i.e. count occurrences of
 	   0:255 in each byte.  Sequential so almost negligible. */
 	// relies on overflow behaviour. And shouldn't -INT_MIN be up in iradix?
@@ -494,7 +575,9 @@ static void iradix(int *x, int *o, int n)
 	    thiscounts[i] = (itmp += thisgrpn);
 	}
     }
-    for (int i = n - 1; i >= 0; i--) {
+    if (nth > 1)
+	par_radixscatter(x, o, n, ikey, radix, nth, thiscounts);
+    else for (int i = n - 1; i >= 0; i--) {
 	thisx = ((unsigned int) (icheck(x[i])) - INT_MIN) >> shift & 0xFF;
 	o[--thiscounts[thisx]] = i + 1;
     }
@@ -627,14 +710,17 @@ static void setNumericRounding(int dround)
     dmask2 = 0xffffffffffffffff << dround * 8;
 }
 
-static union {
+/* local rather than static, as dtwiddle may be called concurrently
+   from par_radixcounts() and par_radixscatter() */
+typedef union {
     double d;
     unsigned long long ull;
-} u;
+} dtwiddle_t;
 
 static
 unsigned long long dtwiddle(void *p, int i, int order)
 {
+    dtwiddle_t u;
     u.d = order * ((double *)p)[i]; // take care of 'order' at the beginning
     if (R_FINITE(u.d)) {
 	u.ull = (u.d != 0.0) ? u.ull + ((u.ull & dmask1) << 1) : 0;
@@ -651,8 +737,7 @@ unsigned long long dtwiddle(void *p, int i, int order)
 
 static bool dnan(void *p, int i)
 {
-    u.d = ((double *) p)[i];
-    return (ISNAN(u.d));
+    return (ISNAN(((double *) p)[i]));
 }
 
 static unsigned long long (*twiddle) (void *, int, int);
@@ -663,6 +748,11 @@ static size_t colSize = 8;
 
 static void dradix_r(unsigned char *xsub, int *osub, int n, int radix);
 
+static unsigned long long dkey(void *x, int i)
+{
+    return twiddle(x, i, order);
+}
+
 #ifdef WORDS_BIGENDIAN
 #define RADIX_BYTE colSize - radix - 1
 #else
@@ -674,9 +764,14 @@ static void dradix(unsigned char *x, int *o, int n)
     int radix, nextradix, itmp, thisgrpn, maxgrpn;
     unsigned int *thiscounts;
     unsigned long long thisx = 0;
+    int nth = R_par_nthreads(n);
     // see comments in iradix for structure.  This follows the same.
     // TO DO: merge iradix in here (almost ready)
-    for (int i = 0; i < n; i++) {
+    if (nth > 1) {
+	par_radixcounts(x, n, dkey, (int) colSize, nth);
+	thisx = dkey(x, n - 1);
+    }
+    else for (int i = 0; i < n; i++) {
 	thisx = twiddle(x, i, order);
 	for (radix = 0; radix < colSize; radix++)
 	    // if dround == 2 then radix 0 and 1 will be all 0 here and skipped.
@@ -724,7 +819,9 @@ static void dradix(unsigned char *x, int *o, int n)
 	    thiscounts[i] = (itmp += thisgrpn);
 	}
     }
-    for (int i = n - 1; i >= 0; i--) {
+    if (nth > 1)
+	par_radixscatter(x, o, n, dkey, radix, nth, thiscounts);
+    else for (int i = n - 1; i >= 0; i--) {
 	thisx = twiddle(x, i, order);
 	o[ --thiscounts[((unsigned char *)&thisx)[RADIX_BYTE]] ] = i + 1;
     }
@@ -1933,6 +2030,7 @@ attribute_hidden SEXP do_radixsort(SEXP call, SEXP op, SEXP args, SEXP rho)
     free(xsub); free(newo);    xsub=newo=NULL;
     free(xtmp);                xtmp=NULL;          xtmp_alloc=0;
     free(otmp);                otmp=NULL;          otmp_alloc=0;
+    free(par_counts);          par_counts=NULL;    par_counts_alloc=0;
     free(csort_otmp);          csort_otmp=NULL;    csort_otmp_alloc=0;
 
     free(cradix_counts);       cradix_counts=NULL; cradix_counts_alloc=0;
@@ -423,18 +423,42 @@ attribute_hidden SEXP do_relop_dflt(SEXP call, SEXP op, SEXP x, SEXP y)
 
 #define ISNA_INT(x) x == NA_INTEGER
 
+/* NA handling is done by selection rather than branching, so that the
+   loops for the common non-recycling cases can be vectorized, and for
+   long vectors run in parallel. */
+#define NR_ELT(OP, x1, ISNA1, x2, ISNA2)				\
+    (((ISNA1(x1)) | (ISNA2(x2))) ? NA_LOGICAL : ((x1) OP (x2)))
+
 #define NR_HELPER(OP, type1, ACCESSOR1, ISNA1, type2, ACCESSOR2, ISNA2) do { \
-	type1 x1, *px1 = ACCESSOR1(s1);					\
-	type2 x2, *px2 = ACCESSOR2(s2);					\
+	const type1 *px1 = ACCESSOR1##_RO(s1);				\
+	const type2 *px2 = ACCESSOR2##_RO(s2);				\
 	int *pa = LOGICAL(ans);						\
-        MOD_ITERATE2(n, n1, n2, i, i1, i2, {                            \
-	    x1 = px1[i1];						\
-	    x2 = px2[i2];						\
-            if (ISNA1(x1) || ISNA2(x2))                                 \
-                pa[i] = NA_LOGICAL;					\
-            else                                                        \
-                pa[i] = (x1 OP x2);					\
-        });                                                             \
+	if (n1 == n2)							\
+	    R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, {			\
+		    type1 x1 = px1[i];					\
+		    type2 x2 = px2[i];					\
+		    pa[i] = NR_ELT(OP, x1, ISNA1, x2, ISNA2);		\
+		});							\
+	else if (n2 == 1) {						\
+	    type2 x2 = px2[0];						\
+	    R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, {			\
+		    type1 x1 = px1[i];					\
+		    pa[i] = NR_ELT(OP, x1, ISNA1, x2, ISNA2);		\
+		});							\
+	}								\
+	else if (n1 == 1) {						\
+	    type1 x1 = px1[0];						\
+	    R_PAR_ITERATE_CHECK(NINTERRUPT, n, i, {			\
+		    type2 x2 = px2[i];					\
+		    pa[i] = NR_ELT(OP, x1, ISNA1, x2, ISNA2);		\
+		});							\
+	}								\
+	else								\
+	    MOD_ITERATE2(n, n1, n2, i, i1, i2, {			\
+		    type1 x1 = px1[i1];					\
+		    type2 x2 = px2[i2];					\
+		    pa[i] = NR_ELT(OP, x1, ISNA1, x2, ISNA2);		\
+		});							\
     } while (0)
 
 #define NUMERIC_RELOP(type1, ACCESSOR1, ISNA1, type2, ACCESSOR2, ISNA2) do { \
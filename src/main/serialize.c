@@ -110,8 +110,9 @@
    CHARSXPs are now handled in a way that preserves both embedded null
    characters and NA_STRING values.
 
-   The XDR save format now only uses the in-memory xdr facility for
-   converting integers and doubles to a portable format.
+   The XDR save format no longer uses the xdr facility at all: integers
+   and doubles are converted to a portable format by byte swapping (see
+   XDRCopy4 and XDRCopy8).
 
    The output format packs the type flag and other flags into a single
    integer.  This produces more compact output for code; it has little
@@ -236,6 +237,51 @@ static int Rsnprintf(char *buf, size_t size, const char *format, ...)
  * Basic Output Routines
  */
 
+/*
+ * XDR Encoding
+ *
+ * XDR stores integers and IEEE doubles in big-endian byte order, so on
+ * big-endian platforms it is the native binary format and on
+ * little-endian ones encoding and decoding just reverse the bytes of
+ * each item.  Doing that here in simple loops, which compilers turn
+ * into byte swap or vector instructions, is much faster than calling
+ * xdr_int or xdr_double for each item.  The source and destination may
+ * be the same.
+ */
+
+#ifdef WORDS_BIGENDIAN
+# define XDRCopy4(dst, src, n) memmove(dst, src, (n) * 4)
+# define XDRCopy8(dst, src, n) memmove(dst, src, (n) * 8)
+#else
+static R_INLINE void XDRCopy4(void *dst, const void *src, R_xlen_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    for (R_xlen_t i = 0; i < n; i++) {
+	uint32_t x;
+	memcpy(&x, s + 4 * i, 4);
+	x = (x << 24) | ((x & 0xff00) << 8) | ((x >> 8) & 0xff00) | (x >> 24);
+	memcpy(d + 4 * i, &x, 4);
+    }
+}
+
+static R_INLINE void XDRCopy8(void *dst, const void *src, R_xlen_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    for (R_xlen_t i = 0; i < n; i++) {
+	uint64_t x;
+	memcpy(&x, s + 8 * i, 8);
+	x = ((x & 0x00000000ffffffffULL) << 32) | (x >> 32);
+	x = ((x & 0x0000ffff0000ffffULL) << 16) |
+	    ((x >> 16) & 0x0000ffff0000ffffULL);
+	x = ((x & 0x00ff00ff00ff00ffULL) << 8) |
+	    ((x >> 8) & 0x00ff00ff00ff00ffULL);
+	memcpy(d + 8 * i, &x, 8);
+    }
+}
+#endif
+
 static void OutInteger(R_outpstream_t stream, int i)
 {
     char buf[128];
@@ -249,10 +295,11 @@ static void OutInteger(R_outpstream_t stream, int i)
 	stream->OutBytes(stream, buf, (int)strlen(buf));
 	break;
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
 	stream->OutBytes(stream, &i, sizeof(int));
 	break;
     case R_pstream_xdr_format:
-	R_XDREncodeInteger(i, buf);
+	XDRCopy4(buf, &i, 1);
 	stream->OutBytes(stream, buf, R_XDR_INTEGER_SIZE);
 	break;
     default:
@@ -296,10 +343,11 @@ static void OutReal(R_outpstream_t stream, double d)
 	stream->OutBytes(stream, buf, (int)strlen(buf));
 	break;
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
 	stream->OutBytes(stream, &d, sizeof(double));
 	break;
     case R_pstream_xdr_format:
-	R_XDREncodeDouble(d, buf);
+	XDRCopy8(buf, &d, 1);
 	stream->OutBytes(stream, buf, R_XDR_DOUBLE_SIZE);
 	break;
     default:
@@ -323,6 +371,7 @@ static void OutByte(R_outpstream_t stream, Rbyte i)
 	stream->OutBytes(stream, buf, (int)strlen(buf));
 	break;
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     case R_pstream_xdr_format:
 	stream->OutBytes(stream, &i, 1);
 	break;
@@ -409,11 +458,13 @@ static int InInteger(R_inpstream_t stream)
 	    if(sscanf(buf, "%d", &i) != 1) error(_("read error"));
 	return i;
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
 	stream->InBytes(stream, &i, sizeof(int));
 	return i;
     case R_pstream_xdr_format:
 	stream->InBytes(stream, buf, R_XDR_INTEGER_SIZE);
-	return R_XDRDecodeInteger(buf);
+	XDRCopy4(&i, buf, 1);
+	return i;
     default:
 	return NA_INTEGER;
     }
@@ -452,11 +503,13 @@ static double InReal(R_inpstream_t stream)
 		!= 1) error(_("read error"));
 	return d;
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
 	stream->InBytes(stream, &d, sizeof(double));
 	return d;
     case R_pstream_xdr_format:
 	stream->InBytes(stream, buf, R_XDR_DOUBLE_SIZE);
-	return R_XDRDecodeDouble(buf);
+	XDRCopy8(&d, buf, 1);
+	return d;
     default:
 	return NA_REAL;
     }
@@ -553,8 +606,9 @@ static void InString(R_inpstream_t stream, char *buf, int length)
 /*
  * Format Header Reading and Writing
  *
- * The header starts with one of three characters, A for ascii, B for
- * binary, or X for xdr.
+ * The header starts with one of four characters, A for ascii, B for
+ * binary, X for xdr, or M for binary with aligned vector data (see
+ * OutAlignPadding).
  */
 
 static void OutFormat(R_outpstream_t stream)
@@ -571,6 +625,7 @@ static void OutFormat(R_outpstream_t stream)
 	   way as ascii_format; the distinction is handled inside scanf %lg */
     case R_pstream_binary_format: stream->OutBytes(stream, "B\n", 2); break;
     case R_pstream_xdr_format:    stream->OutBytes(stream, "X\n", 2); break;
+    case R_pstream_aligned_format: stream->OutBytes(stream, "M\n", 2); break;
     case R_pstream_any_format:
 	error(_("must specify ascii, binary, or xdr format"));
     default: error(_("unknown output format"));
@@ -586,6 +641,7 @@ static void InFormat(R_inpstream_t stream)
     case 'A': type = R_pstream_ascii_format; break; /* also for asciihex */
     case 'B': type = R_pstream_binary_format; break;
     case 'X': type = R_pstream_xdr_format; break;
+    case 'M': type = R_pstream_aligned_format; break;
     case '\n':
 	/* GROSS HACK: ASCII unserialize may leave a trailing newline
 	   in the stream.  If the stream contains a second
@@ -883,9 +939,6 @@ static void OutStringVec(R_outpstream_t stream, SEXP s, SEXP ref_table)
     }
 }
 
-#include <rpc/types.h>
-#include <rpc/xdr.h>
-
 #define CHUNK_SIZE 8096
 
 #define min2(a, b) ((a) < (b)) ? (a) : (b)
@@ -898,22 +951,18 @@ OutIntegerVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
     switch (stream->type) {
     case R_pstream_xdr_format:
     {
-	static char buf[CHUNK_SIZE * sizeof(int)];
+	static int buf[CHUNK_SIZE];
 	R_xlen_t done, this;
-	XDR xdrs;
 	for (done = 0; done < length; done += this) {
 	    IF_IC_R_CheckUserInterrupt();
 	    this = min2(CHUNK_SIZE, length - done);
-	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(int)), XDR_ENCODE);
-	    for(int cnt = 0; cnt < this; cnt++)
-		if(!xdr_int(&xdrs, INTEGER(s) + done + cnt))
-		    error(_("XDR write failed"));
-	    xdr_destroy(&xdrs);
+	    XDRCopy4(buf, INTEGER(s) + done, this);
 	    stream->OutBytes(stream, buf, (int)(sizeof(int) * this));
 	}
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	/* write in chunks to avoid overflowing ints */
 	R_xlen_t done, this;
@@ -940,22 +989,18 @@ OutRealVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
     switch (stream->type) {
     case R_pstream_xdr_format:
     {
-	static char buf[CHUNK_SIZE * sizeof(double)];
+	static double buf[CHUNK_SIZE];
 	R_xlen_t done, this;
-	XDR xdrs;
 	for (done = 0; done < length; done += this) {
 	    IF_IC_R_CheckUserInterrupt();
 	    this = min2(CHUNK_SIZE, length - done);
-	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(double)), XDR_ENCODE);
-	    for(int cnt = 0; cnt < this; cnt++)
-		if(!xdr_double(&xdrs, REAL(s) + done + cnt))
-		    error(_("XDR write failed"));
-	    xdr_destroy(&xdrs);
+	    XDRCopy8(buf, REAL(s) + done, this);
 	    stream->OutBytes(stream, buf, (int)(sizeof(double) * this));
 	}
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	R_xlen_t done, this;
 	for (done = 0; done < length; done += this) {
@@ -981,25 +1026,18 @@ OutComplexVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
     switch (stream->type) {
     case R_pstream_xdr_format:
     {
-	static char buf[CHUNK_SIZE * sizeof(Rcomplex)];
+	static Rcomplex buf[CHUNK_SIZE];
 	R_xlen_t done, this;
-	XDR xdrs;
-	Rcomplex *c = COMPLEX(s);
 	for (done = 0; done < length; done += this) {
 	    IF_IC_R_CheckUserInterrupt();
 	    this = min2(CHUNK_SIZE, length - done);
-	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(Rcomplex)), XDR_ENCODE);
-	    for(int cnt = 0; cnt < this; cnt++) {
-		if(!xdr_double(&xdrs, &(c[done+cnt].r)) ||
-		   !xdr_double(&xdrs, &(c[done+cnt].i)))
-		    error(_("XDR write failed"));
-	    }
+	    XDRCopy8(buf, COMPLEX(s) + done, 2 * this);
 	    stream->OutBytes(stream, buf, (int)(sizeof(Rcomplex) * this));
-	    xdr_destroy(&xdrs);
 	}
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	R_xlen_t done, this;
 	for (done = 0; done < length; done += this) {
@@ -1018,6 +1056,101 @@ OutComplexVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
     }
 }
 
+/* Write the elements of a character vector in a binary format.  The
+   output is that of WriteItem on each CHARSXP (which are never
+   persistent, special or in the reference table), but the flags,
+   lengths and bytes of the strings are collected in a buffer so that
+   there is one OutBytes call per chunk rather than three per string. */
+static void
+OutCharsxpVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
+{
+    static char buf[CHUNK_SIZE * sizeof(double)];
+    size_t used = 0;
+    int ic = 9999;
+    for (R_xlen_t i = 0; i < length; i++) {
+	IF_IC_R_CheckUserInterrupt();
+	SEXP c = STRING_ELT(s, i);
+	int hdr[2];
+	int nc = c == NA_STRING ? 0 : LENGTH(c);
+	hdr[0] = PackFlags(CHARSXP, LEVELS(c), OBJECT(c), 0, 0);
+	hdr[1] = c == NA_STRING ? -1 : nc;
+	if (used + sizeof(hdr) + nc > sizeof(buf)) {
+	    if (used) stream->OutBytes(stream, buf, (int) used);
+	    used = 0;
+	    if (sizeof(hdr) + nc > sizeof(buf)) {
+		OutInteger(stream, hdr[0]);
+		OutInteger(stream, hdr[1]);
+		OutString(stream, CHAR(c), nc);
+		continue;
+	    }
+	}
+	if (stream->type == R_pstream_xdr_format)
+	    XDRCopy4(buf + used, hdr, 2);
+	else
+	    memcpy(buf + used, hdr, sizeof(hdr));
+	used += sizeof(hdr);
+	if (nc) {
+	    memcpy(buf + used, CHAR(c), nc);
+	    used += nc;
+	}
+    }
+    if (used) stream->OutBytes(stream, buf, (int) used);
+}
+
+/*
+ * Aligned Vector Data
+ *
+ * The aligned format is the native binary format, except that the
+ * data of each atomic vector is preceded by an integer count and that
+ * many padding bytes.  The data of vectors of at least ALIGN_MIN bytes
+ * is padded to start at a multiple of ALIGN_SIZE bytes from the start
+ * of the stream, a multiple of the page size on all platforms we know
+ * of, so that they can be memory mapped when read from a file (see
+ * InMappedVector).
+ *
+ * The padding depends on the number of bytes written so far, which
+ * output streams do not record: R_Serialize interposes
+ * OutBytesAligned to count them.
+ */
+
+#define ALIGN_SIZE 65536
+#define ALIGN_MIN 1048576
+
+typedef struct alignbuf_st {
+    R_pstream_data_t data;
+    void (*OutBytes)(R_outpstream_t, void *, int);
+    R_size_t count;
+} *alignbuf_t;
+
+static void OutBytesAligned(R_outpstream_t stream, void *buf, int length)
+{
+    alignbuf_t ab = stream->data;
+    stream->data = ab->data; /* as expected by the stream's OutBytes */
+    ab->OutBytes(stream, buf, length);
+    stream->data = ab;
+    ab->count += length;
+}
+
+static void OutAlignPadding(R_outpstream_t stream, R_xlen_t nbytes)
+{
+    static char zeros[4096];
+
+    if (stream->type != R_pstream_aligned_format)
+	return;
+    int pad = 0;
+    if (nbytes >= ALIGN_MIN) {
+	alignbuf_t ab = stream->data;
+	R_size_t pos = ab->count + sizeof(int);
+	pad = (int) ((ALIGN_SIZE - pos % ALIGN_SIZE) % ALIGN_SIZE);
+    }
+    OutInteger(stream, pad);
+    while (pad > 0) {
+	int n = min2(pad, (int) sizeof(zeros));
+	stream->OutBytes(stream, zeros, n);
+	pad -= n;
+    }
+}
+
 static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream)
 {
     if (R_compile_pkgs && TYPEOF(s) == CLOSXP && TYPEOF(BODY(s)) != BCODESXP &&
@@ -1188,24 +1321,39 @@ static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream)
 	case INTSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
+	    OutAlignPadding(stream, len * sizeof(int));
 	    OutIntegerVec(stream, s, len);
 	    break;
 	case REALSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
+	    OutAlignPadding(stream, len * sizeof(double));
 	    OutRealVec(stream, s, len);
 	    break;
 	case CPLXSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
+	    OutAlignPadding(stream, len * sizeof(Rcomplex));
 	    OutComplexVec(stream, s, len);
 	    break;
 	case STRSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
-	    for (R_xlen_t ix = 0; ix < len; ix++) {
-		IF_IC_R_CheckUserInterrupt();
-		WriteItem(STRING_ELT(s, ix), ref_table, stream);
+	    switch (stream->type) {
+	    case R_pstream_xdr_format:
+	    case R_pstream_binary_format:
+	    case R_pstream_aligned_format:
+		/* ALTREP elements might be computed by R code */
+		if (!ALTREP(s)) {
+		    OutCharsxpVec(stream, s, len);
+		    break;
+		}
+		/* else fall through */
+	    default:
+		for (R_xlen_t ix = 0; ix < len; ix++) {
+		    IF_IC_R_CheckUserInterrupt();
+		    WriteItem(STRING_ELT(s, ix), ref_table, stream);
+		}
 	    }
 	    break;
 	case VECSXP:
@@ -1223,9 +1371,11 @@ static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream)
 	case RAWSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
+	    OutAlignPadding(stream, len);
 	    switch (stream->type) {
 	    case R_pstream_xdr_format:
 	    case R_pstream_binary_format:
+	    case R_pstream_aligned_format:
 	    {
 		R_xlen_t done, this;
 		for (done = 0; done < len; done += this) {
@@ -1411,6 +1561,15 @@ static void WriteBC(SEXP s, SEXP ref_table, R_outpstream_t stream)
 void R_Serialize(SEXP s, R_outpstream_t stream)
 {
     int version = stream->version;
+    struct alignbuf_st ab;
+
+    if (stream->type == R_pstream_aligned_format) {
+	ab.data = stream->data;
+	ab.OutBytes = stream->OutBytes;
+	ab.count = 0;
+	stream->data = &ab;
+	stream->OutBytes = OutBytesAligned;
+    }
 
     OutFormat(stream);
 
@@ -1437,6 +1596,11 @@ void R_Serialize(SEXP s, R_outpstream_t stream)
     SEXP ref_table = PROTECT(MakeHashTable());
     WriteItem(s, ref_table, stream);
     UNPROTECT(1);
+
+    if (stream->type == R_pstream_aligned_format) {
+	stream->data = ab.data;
+	stream->OutBytes = ab.OutBytes;
+    }
 }
 
 
@@ -1510,21 +1674,16 @@ InIntegerVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
     switch (stream->type) {
     case R_pstream_xdr_format:
     {
-	static char buf[CHUNK_SIZE * sizeof(int)];
 	R_xlen_t done, this;
-	XDR xdrs;
 	for (done = 0; done < length; done += this) {
 	    this = min2(CHUNK_SIZE, length - done);
-	    stream->InBytes(stream, buf, (int)(sizeof(int) * this));
-	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(int)), XDR_DECODE);
-	    for(int cnt = 0; cnt < this; cnt++)
-		if(!xdr_int(&xdrs, INTEGER(obj) + done + cnt))
-		    error(_("XDR read failed"));
-	    xdr_destroy(&xdrs);
+	    stream->InBytes(stream, INTEGER(obj) + done, (int)(sizeof(int) * this));
+	    XDRCopy4(INTEGER(obj) + done, INTEGER(obj) + done, this);
 	}
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	R_xlen_t done, this;
 	for (done = 0; done < length; done += this) {
@@ -1546,21 +1705,16 @@ InRealVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
     switch (stream->type) {
     case R_pstream_xdr_format:
     {
-	static char buf[CHUNK_SIZE * sizeof(double)];
 	R_xlen_t done, this;
-	XDR xdrs;
 	for (done = 0; done < length; done += this) {
 	    this = min2(CHUNK_SIZE, length - done);
-	    stream->InBytes(stream, buf, (int)(sizeof(double) * this));
-	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(double)), XDR_DECODE);
-	    for(R_xlen_t cnt = 0; cnt < this; cnt++)
-		if(!xdr_double(&xdrs, REAL(obj) + done + cnt))
-		    error(_("XDR read failed"));
-	    xdr_destroy(&xdrs);
+	    stream->InBytes(stream, REAL(obj) + done, (int)(sizeof(double) * this));
+	    XDRCopy8(REAL(obj) + done, REAL(obj) + done, this);
 	}
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	R_xlen_t done, this;
 	for (done = 0; done < length; done += this) {
@@ -1582,24 +1736,18 @@ InComplexVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
     switch (stream->type) {
     case R_pstream_xdr_format:
     {
-	static char buf[CHUNK_SIZE * sizeof(Rcomplex)];
 	R_xlen_t done, this;
-	XDR xdrs;
 	Rcomplex *output = COMPLEX(obj);
 	for (done = 0; done < length; done += this) {
 	    this = min2(CHUNK_SIZE, length - done);
-	    stream->InBytes(stream, buf, (int)(sizeof(Rcomplex) * this));
-	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(Rcomplex)), XDR_DECODE);
-	    for(R_xlen_t cnt = 0; cnt < this; cnt++) {
-		if(!xdr_double(&xdrs, &(output[done+cnt].r)) ||
-		   !xdr_double(&xdrs, &(output[done+cnt].i)))
-		    error(_("XDR read failed"));
-	    }
-	    xdr_destroy(&xdrs);
+	    stream->InBytes(stream, output + done,
+			    (int)(sizeof(Rcomplex) * this));
+	    XDRCopy8(output + done, output + done, 2 * this);
 	}
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	R_xlen_t done, this;
 	for (done = 0; done < length; done += this) {
@@ -1615,6 +1763,75 @@ InComplexVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
     }
 }
 
+/*
+ * Memory Mapped Input
+ *
+ * readRDS(mmap = TRUE) reads files in the aligned format through a
+ * FILE * stream recording the file position.  Integer and double
+ * vectors whose data was aligned by OutAlignPadding are then memory
+ * mapped rather than read, as read-only vectors which are duplicated
+ * when modified.
+ */
+
+typedef struct mapfile_st {
+    FILE *fp;
+    SEXP file;
+    double pos;
+} *mapfile_t;
+
+static int InCharMapped(R_inpstream_t stream)
+{
+    mapfile_t mf = stream->data;
+    mf->pos++;
+    return fgetc(mf->fp);
+}
+
+static void InBytesMapped(R_inpstream_t stream, void *buf, int length)
+{
+    mapfile_t mf = stream->data;
+    size_t in = fread(buf, 1, length, mf->fp);
+    if (in != length) error(_("read failed"));
+    mf->pos += length;
+}
+
+/* Skip the padding of the aligned format and return the vector mapped
+   from the file if possible, otherwise NULL for the data to be read. */
+static SEXP InMappedVector(R_inpstream_t stream, SEXPTYPE type, R_xlen_t len)
+{
+    if (stream->type != R_pstream_aligned_format)
+	return NULL;
+
+    int pad = InInteger(stream);
+    if (pad < 0 || pad >= ALIGN_SIZE)
+	error(_("invalid padding"));
+    while (pad > 0) {
+	char buf[4096];
+	int n = min2(pad, (int) sizeof(buf));
+	stream->InBytes(stream, buf, n);
+	pad -= n;
+    }
+
+    if (stream->InBytes != InBytesMapped || len == 0 ||
+	(type != INTSXP && type != REALSXP))
+	return NULL;
+    size_t size = len * (type == INTSXP ? sizeof(int) : sizeof(double));
+    if (size < ALIGN_MIN)
+	return NULL;
+    mapfile_t mf = stream->data;
+    SEXP s = R_mmap_file_region(mf->file, fileno(mf->fp), mf->pos,
+				size, type);
+    if (s != NULL) {
+#ifdef HAVE_FSEEKO
+	if (fseeko(mf->fp, (off_t) size, SEEK_CUR) != 0)
+#else
+	if (fseek(mf->fp, (long) size, SEEK_CUR) != 0)
+#endif
+	    error(_("read failed"));
+	mf->pos += size;
+    }
+    return s;
+}
+
 static int TryConvertString(void *obj, const char *inp, size_t inplen,
                             char *buf, size_t *bufleft)
 {
@@ -2018,16 +2235,25 @@ static SEXP ReadItem_Recursive (int flags, SEXP ref_table, R_inpstream_t stream)
 	case LGLSXP:
 	case INTSXP:
 	    len = ReadLENGTH(stream);
+	    if ((s = InMappedVector(stream, type, len)) != NULL) {
+		PROTECT(s);
+		break;
+	    }
 	    PROTECT(s = allocVector(type, len));
 	    InIntegerVec(stream, s, len);
 	    break;
 	case REALSXP:
 	    len = ReadLENGTH(stream);
+	    if ((s = InMappedVector(stream, type, len)) != NULL) {
+		PROTECT(s);
+		break;
+	    }
 	    PROTECT(s = allocVector(type, len));
 	    InRealVec(stream, s, len);
 	    break;
 	case CPLXSXP:
 	    len = ReadLENGTH(stream);
+	    InMappedVector(stream, type, len); /* skips padding */
 	    PROTECT(s = allocVector(type, len));
 	    InComplexVec(stream, s, len);
 	    break;
@@ -2061,6 +2287,7 @@ static SEXP ReadItem_Recursive (int flags, SEXP ref_table, R_inpstream_t stream)
 	    error(_("this version of R cannot read generic function references"));
 	case RAWSXP:
 	    len = ReadLENGTH(stream);
+	    InMappedVector(stream, type, len); /* skips padding */
 	    PROTECT(s = allocVector(type, len));
 	    switch (stream->type) {
 	    case R_pstream_ascii_format:
@@ -2336,6 +2563,9 @@ attribute_hidden SEXP R_SerializeInfo(R_inpstream_t stream)
     case R_pstream_xdr_format:
 	SET_VECTOR_ELT(ans, 3, mkString("xdr"));
 	break;
+    case R_pstream_aligned_format:
+	SET_VECTOR_ELT(ans, 3, mkString("aligned"));
+	break;
     default:
 	error(_("unknown input format"));
     }
@@ -2947,6 +3177,7 @@ R_serialize(SEXP object, SEXP icon, SEXP ascii, SEXP Sversion, SEXP fun)
     case 1: type = R_pstream_ascii_format; break;
     case 2: type = R_pstream_asciihex_format; break;
     case 3: type = R_pstream_binary_format; break;
+    case 4: type = R_pstream_aligned_format; break;
     default: type = R_pstream_xdr_format; break;
     }
 
@@ -3008,6 +3239,48 @@ static SEXP R_unserialize(SEXP icon, SEXP fun)
 }
 
 
+static void mapfile_cleanup(void *data)
+{
+    mapfile_t mf = data;
+    if (mf->fp) fclose(mf->fp);
+}
+
+/* used by readRDS(mmap = TRUE) for files in the aligned format */
+static SEXP R_unserializeMapped(SEXP file, SEXP fun)
+{
+    struct R_inpstream_st in;
+    struct mapfile_st mf;
+    SEXP (*hook)(SEXP, SEXP);
+    RCNTXT cntxt;
+
+    if (!isString(file) || LENGTH(file) != 1 || STRING_ELT(file, 0) == NA_STRING)
+	error(_("invalid '%s' argument"), "file");
+    hook = fun != R_NilValue ? CallHook : NULL;
+
+    const char *efn = R_ExpandFileName(translateCharFP(STRING_ELT(file, 0)));
+    mf.fp = R_fopen(efn, "rb");
+    if (mf.fp == NULL)
+	error(_("cannot open file '%s': %s"), efn, strerror(errno));
+    mf.file = file;
+    mf.pos = 0;
+
+    /* set up a context which will close the file if there is an error */
+    begincontext(&cntxt, CTXT_CCODE, R_NilValue, R_BaseEnv, R_BaseEnv,
+		 R_NilValue, R_NilValue);
+    cntxt.cend = &mapfile_cleanup;
+    cntxt.cenddata = &mf;
+
+    R_InitInPStream(&in, (R_pstream_data_t) &mf, R_pstream_aligned_format,
+		    InCharMapped, InBytesMapped, hook, fun);
+    SEXP val = PROTECT(R_Unserialize(&in));
+
+    endcontext(&cntxt);
+    fclose(mf.fp);
+    UNPROTECT(1); /* val */
+    return val;
+}
+
+
 /*
  * Support Code for Lazy Loading of Packages
  */
@@ -3015,15 +3288,31 @@ static SEXP R_unserialize(SEXP icon, SEXP fun)
 
 #define IS_PROPER_STRING(s) (TYPEOF(s) == STRSXP && LENGTH(s) > 0)
 
+/* as in connections.c */
+#ifdef Win32
+# define f_seek fseeko64
+# define f_tell ftello64
+# define OFF_T off64_t
+#elif defined(HAVE_OFF_T) && defined(HAVE_FSEEKO)
+# define f_seek fseeko
+# define f_tell ftello
+# define OFF_T off_t
+#else
+# define f_seek fseek
+# define f_tell ftell
+# define OFF_T long
+#endif
+
 /* Appends a raw vector to the end of a file using binary mode.
-   Returns an integer vector of the initial offset of the string in
-   the file and the length of the vector. */
+   Returns a vector of the initial offset of the string in the file
+   and the length of the vector: an integer vector unless the offset
+   is too large for an integer, when it is a double vector. */
 
 static SEXP appendRawToFile(SEXP file, SEXP bytes)
 {
     FILE *fp;
     size_t len, out;
-    long pos;  // what ftell gives: won't work for > 2GB files
+    OFF_T pos;
     SEXP val;
     const void *vmax;
     const char *cfile;
@@ -3045,67 +3334,193 @@ static SEXP appendRawToFile(SEXP file, SEXP bytes)
 	error( _("cannot open file '%s': %s"), cfile,
 	       strerror(errno));
     }
-    if (fseek(fp, 0, SEEK_END) != 0) {
+    if (f_seek(fp, 0, SEEK_END) != 0) {
 	fclose(fp);
 	error(_("seek failed on %s"), cfile);
     }
 #endif
 
     len = LENGTH(bytes);
-    pos = ftell(fp);
+    pos = f_tell(fp);
     out = fwrite(RAW(bytes), 1, len, fp);
     fclose(fp);
 
     if (out != len) error(_("write failed"));
     if (pos == -1) error(_("could not determine file position"));
 
-    val = allocVector(INTSXP, 2);
-    INTEGER(val)[0] = (int) pos;
-    INTEGER(val)[1] = (int) len;
+    if (pos <= INT_MAX) {
+	val = allocVector(INTSXP, 2);
+	INTEGER(val)[0] = (int) pos;
+	INTEGER(val)[1] = (int) len;
+    } else {
+	val = allocVector(REALSXP, 2);
+	REAL(val)[0] = (double) pos;
+	REAL(val)[1] = (double) len;
+    }
     vmaxset(vmax);
 
     return val;
 }
 
-/* Interface to cache the pkg.rdb files */
+/* Interface to cache the pkg.rdb files.
+
+   Where possible a file is memory mapped when an entry is first read
+   from it, and the kernel asked to read ahead all of it if it is less
+   than LEN_LIMIT bytes, so that later entries are copied from memory
+   and the pages are shared by all the processes using the database.
+   Larger files, such as those of saveChunked(), are paged in only as
+   their entries are read.  Otherwise files of less than LEN_LIMIT
+   bytes are read into memory.
+
+   As accessing a mapping beyond the end of a file which has been
+   truncated would crash the process, the file mapped is kept open and
+   checked by fstat() before each use, and the mapping dropped if the
+   file has been changed in place.  A file replaced under the same
+   name, as when a package is reinstalled, is a new file: the mapping
+   of the old one stays valid and is kept, as the keys in use were
+   made for it, just as a copy read into memory is.  Entries beyond
+   the end of the cached copy, appended since it was made, are read
+   from the file after dropping it.  Lookups try the file used last first, as most
+   runs of fetches are from the same package. */
+
+#if defined(HAVE_MMAP) && !defined(Win32)
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+# define MMAP_RDB
+#endif
 
 #define NC 100
-static int used = 0;
+static int used = 0, last = -1;
 static char *names[NC];
 static char *ptr[NC];
+static size_t sizes[NC];
+static bool mapped[NC];
+#ifdef MMAP_RDB
+static int fds[NC]; /* of mapped files */
+static struct stat stats[NC];
+#endif
+
+static void dropCachedFile(int i)
+{
+    free(names[i]);
+    names[i] = NULL;
+#ifdef MMAP_RDB
+    if (mapped[i]) {
+	munmap(ptr[i], sizes[i]);
+	close(fds[i]);
+    } else
+#endif
+	free(ptr[i]);
+    ptr[i] = NULL;
+    if (last == i) last = -1;
+}
+
+static int findCachedFile(const char *cfile)
+{
+    int i = -1;
+    if (last >= 0 && names[last] != NULL && strcmp(cfile, names[last]) == 0)
+	i = last;
+    else
+	for (int j = 0; j < used; j++)
+	    if (names[j] != NULL && strcmp(cfile, names[j]) == 0) {
+		i = last = j;
+		break;
+	    }
+#ifdef MMAP_RDB
+    struct stat sb;
+    if (i >= 0 && mapped[i] &&
+	(fstat(fds[i], &sb) != 0 || sb.st_size != stats[i].st_size ||
+	 sb.st_mtime != stats[i].st_mtime)) {
+	dropCachedFile(i);
+	i = -1;
+    }
+#endif
+    return i;
+}
 
 attribute_hidden SEXP
 do_lazyLoadDBflush(SEXP call, SEXP op, SEXP args, SEXP env)
 {
     checkArity(op, args);
 
-    int i;
     const char *cfile = translateCharFP(STRING_ELT(CAR(args), 0));
-
-    /* fprintf(stderr, "flushing file %s", cfile); */
-    for (i = 0; i < used; i++)
-	if(names[i] != NULL && strcmp(cfile, names[i]) == 0) {
-	    free(names[i]);
-	    names[i] = NULL;
-	    free(ptr[i]);
-	    /* fprintf(stderr, " found at pos %d in cache", i); */
-	    break;
-	}
-    /* fprintf(stderr, "\n"); */
+    int i = findCachedFile(cfile);
+    if (i >= 0)
+	dropCachedFile(i);
     return R_NilValue;
 }
 
+/* There are some large lazy-data examples, e.g. 80Mb for SNPMaP.cdm */
+#define LEN_LIMIT 10*1048576
+
+/* Caches the open file fp, of length filelen, in slot i.  Returns
+   false if it could not be cached. */
+static bool cacheFile(int i, const char *cfile, FILE *fp, OFF_T filelen)
+{
+    char *p = NULL, *n;
+    bool map = FALSE;
+
+    if (filelen <= 0 || (double) filelen > (double) SIZE_MAX)
+	return FALSE;
+#ifdef MMAP_RDB
+    if (fstat(fileno(fp), &stats[i]) == 0 && stats[i].st_size == filelen &&
+	(fds[i] = dup(fileno(fp))) >= 0) {
+	p = mmap(NULL, (size_t) filelen, PROT_READ, MAP_PRIVATE,
+		 fileno(fp), 0);
+	if (p == MAP_FAILED) {
+	    p = NULL;
+	    close(fds[i]);
+	} else {
+	    map = TRUE;
+# ifdef MADV_WILLNEED
+	    if (filelen < LEN_LIMIT)
+		madvise(p, (size_t) filelen, MADV_WILLNEED);
+# endif
+	}
+    }
+#endif
+    if (p == NULL && filelen < LEN_LIMIT) {
+	p = (char *) malloc(filelen);
+	if (p) {
+	    if (f_seek(fp, 0, SEEK_SET) != 0 ||
+		fread(p, 1, filelen, fp) != (size_t) filelen) {
+		free(p);
+		return FALSE;
+	    }
+	}
+    }
+    if (p == NULL)
+	return FALSE;
+    n = (char *) malloc(strlen(cfile) + 1);
+    if (n == NULL) {
+#ifdef MMAP_RDB
+	if (map) {
+	    munmap(p, (size_t) filelen);
+	    close(fds[i]);
+	} else
+#endif
+	    free(p);
+	return FALSE;
+    }
+    strcpy(n, cfile);
+    names[i] = n;
+    ptr[i] = p;
+    sizes[i] = (size_t) filelen;
+    mapped[i] = map;
+    last = i;
+    return TRUE;
+}
 
 /* Reads, in binary mode, the bytes in the range specified by a
-   position/length vector and returns them as raw vector. */
+   position/length vector (integer or double) and returns them as raw
+   vector. */
 
-/* There are some large lazy-data examples, e.g. 80Mb for SNPMaP.cdm */
-#define LEN_LIMIT 10*1048576
 static SEXP readRawFromFile(SEXP file, SEXP key)
 {
     FILE *fp;
-    int offset, len, in, i, icache = -1;
-    long filelen;
+    OFF_T offset, filelen;
+    int len, in, i, icache;
     SEXP val;
     const void *vmax;
     const char *cfile;
@@ -3114,24 +3529,35 @@ static SEXP readRawFromFile(SEXP file, SEXP key)
 	error(_("not a proper file name"));
     vmax = vmaxget();
     cfile = translateCharFP(STRING_ELT(file, 0));
-    if (TYPEOF(key) != INTSXP || LENGTH(key) != 2)
+    if (TYPEOF(key) == INTSXP && LENGTH(key) == 2) {
+	offset = INTEGER(key)[0];
+	len = INTEGER(key)[1];
+    } else if (TYPEOF(key) == REALSXP && LENGTH(key) == 2) {
+	offset = (OFF_T) REAL(key)[0];
+	len = (int) REAL(key)[1];
+    } else
+	error(_("bad offset/length argument"));
+    if (offset < 0 || len < 0)
 	error(_("bad offset/length argument"));
-
-    offset = INTEGER(key)[0];
-    len = INTEGER(key)[1];
 
     val = allocVector(RAWSXP, len);
     /* Do we have this database cached? */
-    for (i = 0; i < used; i++)
-	if(names[i] != NULL && strcmp(cfile, names[i]) == 0) {icache = i; break;}
+    icache = findCachedFile(cfile);
     if (icache >= 0) {
-	if (len)
-	    memcpy(RAW(val), ptr[icache]+offset, len);
-	vmaxset(vmax);
-	return val;
+	if ((double) offset + len <= (double) sizes[icache]) {
+	    if (len)
+		memcpy(RAW(val), ptr[icache] + offset, len);
+	    vmaxset(vmax);
+	    return val;
+	}
+	dropCachedFile(icache);
     }
 
+    if ((fp = R_fopen(cfile, "rb")) == NULL)
+	error(_("cannot open file '%s': %s"), cfile, strerror(errno));
+
     /* find a vacant slot? */
+    icache = -1;
     for (i = 0; i < used; i++)
 	if(names[i] == NULL) {icache = i; break;}
     if(icache < 0 && used < NC) {
@@ -3139,64 +3565,23 @@ static SEXP readRawFromFile(SEXP file, SEXP key)
 	names[icache] = NULL;
     }
 
-    if(icache >= 0) {
-	if ((fp = R_fopen(cfile, "rb")) == NULL)
-	    error(_("cannot open file '%s': %s"), cfile, strerror(errno));
-	if (fseek(fp, 0, SEEK_END) != 0) {
+    if (icache >= 0) {
+	if (f_seek(fp, 0, SEEK_END) != 0) {
 	    fclose(fp);
 	    error(_("seek failed on %s"), cfile);
 	}
-	filelen = ftell(fp);
-	if (filelen < LEN_LIMIT) {
-	    char *p, *n;
-	    /* fprintf(stderr, "adding file '%s' at pos %d in cache, length %d\n",
-	       cfile, icache, filelen); */
-	    p = (char *) malloc(filelen);
-	    n = (char *) malloc(strlen(cfile) + 1);
-	    if (p && n) {
-		names[icache] = n;
-		strcpy(names[icache], cfile);
-		ptr[icache] = p;
-		if (fseek(fp, 0, SEEK_SET) != 0) {
-		    fclose(fp);
-		    error(_("seek failed on %s"), cfile);
-		}
-		in = (int) fread(p, 1, filelen, fp);
-		fclose(fp);
-		if (filelen != in) error(_("read failed on %s"), cfile);
-		if (len)
-		    memcpy(RAW(val), p+offset, len);
-	    } else {
-		if (p)
-		    free(p);
-		if (n)
-		    free(n);
-		if (fseek(fp, offset, SEEK_SET) != 0) {
-		    fclose(fp);
-		    error(_("seek failed on %s"), cfile);
-		}
-		in = (int) fread(RAW(val), 1, len, fp);
-		fclose(fp);
-		if (len != in) error(_("read failed on %s"), cfile);
-	    }
-	    vmaxset(vmax);
-	    return val;
-	} else {
-	    if (fseek(fp, offset, SEEK_SET) != 0) {
-		fclose(fp);
-		error(_("seek failed on %s"), cfile);
-	    }
-	    in = (int) fread(RAW(val), 1, len, fp);
+	filelen = f_tell(fp);
+	if ((double) offset + len <= (double) filelen &&
+	    cacheFile(icache, cfile, fp, filelen)) {
 	    fclose(fp);
-	    if (len != in) error(_("read failed on %s"), cfile);
+	    if (len)
+		memcpy(RAW(val), ptr[icache] + offset, len);
 	    vmaxset(vmax);
 	    return val;
 	}
     }
 
-    if ((fp = R_fopen(cfile, "rb")) == NULL)
-	error(_("cannot open file '%s': %s"), cfile, strerror(errno));
-    if (fseek(fp, offset, SEEK_SET) != 0) {
+    if (f_seek(fp, offset, SEEK_SET) != 0) {
 	fclose(fp);
 	error(_("seek failed on %s"), cfile);
     }
@@ -3288,24 +3673,16 @@ R_lazyLoadDBinsertValue(SEXP value, SEXP file, SEXP ascii,
 
 /* Retrieves a sequence of bytes as specified by a position/length key
    from a file, optionally decompresses, and unserializes the bytes.
-   If the result is a promise, then the promise is forced. */
+   If the result is a promise, then the promise is forced.  Also used
+   by the chunked vectors in altclasses.c. */
 
 attribute_hidden SEXP
-do_lazyLoadDBfetch(SEXP call, SEXP op, SEXP args, SEXP env)
+R_lazyLoadDBfetch(SEXP key, SEXP file, int compressed, SEXP hook)
 {
-    SEXP key, file, compsxp, hook;
     PROTECT_INDEX vpi;
-    int compressed;
     Rboolean err = FALSE;
     SEXP val;
 
-    checkArity(op, args);
-    key = CAR(args); args = CDR(args);
-    file = CAR(args); args = CDR(args);
-    compsxp = CAR(args); args = CDR(args);
-    hook = CAR(args);
-    compressed = asInteger(compsxp);
-
     PROTECT_WITH_INDEX(val = readRawFromFile(file, key), &vpi);
     if (compressed == 3)
 	REPROTECT(val = R_decompress3(val, &err), vpi);
@@ -3325,6 +3702,19 @@ do_lazyLoadDBfetch(SEXP call, SEXP op, SEXP args, SEXP env)
     return val;
 }
 
+attribute_hidden SEXP
+do_lazyLoadDBfetch(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    SEXP key, file, compsxp, hook;
+
+    checkArity(op, args);
+    key = CAR(args); args = CDR(args);
+    file = CAR(args); args = CDR(args);
+    compsxp = CAR(args); args = CDR(args);
+    hook = CAR(args);
+    return R_lazyLoadDBfetch(key, file, asInteger(compsxp), hook);
+}
+
 attribute_hidden SEXP
 do_getVarsFromFrame(SEXP call, SEXP op, SEXP args, SEXP env)
 {
@@ -3352,6 +3742,8 @@ do_serialize(SEXP call, SEXP op, SEXP args, SEXP env)
     checkArity(op, args);
     if (PRIMVAL(op) == 2) //return R_unserialize(CAR(args), CADR(args));
 	return checkNotPromise(R_unserialize(CAR(args), CADR(args)));
+    if (PRIMVAL(op) == 3)
+	return checkNotPromise(R_unserializeMapped(CAR(args), CADR(args)));
     SEXP object, icon, type, ver, fun;
     object = CAR(args); args = CDR(args);
     icon = CAR(args); args = CDR(args);
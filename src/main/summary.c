@@ -47,6 +47,43 @@
 #define DbgP3(s,a,b)
 #endif
 
+/* Reductions over long vectors with a data pointer are done in chunks
+   of PAR_CHUNK elements: the chunks are summarized in parallel when math
+   threads are enabled (see R_par_nthreads), and the chunk summaries are
+   combined in order on the main thread.  As the chunks do not depend on
+   the number of threads, neither does the result. */
+#define PAR_CHUNK 65536
+#define PAR_NCHUNKS(n) (((n) + PAR_CHUNK - 1) / PAR_CHUNK)
+#define USE_CHUNKS(n, px) ((n) >= R_PAR_MIN_LENGTH && (px) != NULL)
+
+#ifdef _OPENMP
+# define FOR_CHUNKS(n, c, lo, hi, ...) do {				\
+	R_xlen_t __nch__ = PAR_NCHUNKS(n);				\
+	int __nth__ = R_par_nthreads(n);				\
+	R_PAR_PRAGMA_(omp parallel for if(__nth__ > 1)			\
+		      num_threads(__nth__) schedule(static))		\
+	for (R_xlen_t c = 0; c < __nch__; c++) {			\
+	    R_xlen_t lo = c * PAR_CHUNK;				\
+	    R_xlen_t hi = (n) - lo > PAR_CHUNK ? lo + PAR_CHUNK : (n);	\
+	    __VA_ARGS__							\
+	}								\
+    } while (0)
+#else
+# define FOR_CHUNKS(n, c, lo, hi, ...) do {				\
+	R_xlen_t __nch__ = PAR_NCHUNKS(n);				\
+	for (R_xlen_t c = 0; c < __nch__; c++) {			\
+	    R_xlen_t lo = c * PAR_CHUNK;				\
+	    R_xlen_t hi = (n) - lo > PAR_CHUNK ? lo + PAR_CHUNK : (n);	\
+	    __VA_ARGS__							\
+	}								\
+    } while (0)
+#endif
+
+/* chunk summaries: 'na' is set for an NA when it determines the result */
+typedef struct { LDOUBLE s; bool updated, na; } ldchunk_t;
+typedef struct { double s; bool updated; } dchunk_t;
+typedef struct { int s; bool updated, na; } ichunk_t;
+
 #ifdef LONG_INT // defined in Defn.h
 # define isum_INT LONG_INT
 static int isum(SEXP sx, isum_INT *value, bool narm, SEXP call)
@@ -74,6 +111,44 @@ static int isum(SEXP sx, isum_INT *value, bool narm, SEXP call)
 # define ISUM_OVERFLOW_CHECK do { } while(0)
 #endif
 
+    R_xlen_t n = XLENGTH(sx);
+    const int *px = INTEGER_OR_NULL(sx);
+    if (USE_CHUNKS(n, px)) {
+	/* the sum of a chunk cannot overflow a LONG_INT */
+	typedef struct { LONG_INT s; bool updated, na; } lichunk_t;
+	const void *vmax = vmaxget();
+	lichunk_t *cs = (lichunk_t *) R_alloc(PAR_NCHUNKS(n), sizeof(lichunk_t));
+	FOR_CHUNKS(n, c, lo, hi, {
+		LONG_INT cs_ = 0;
+		bool cu_ = false, cna_ = false;
+		for (R_xlen_t k = lo; k < hi; k++) {
+		    if (px[k] != NA_INTEGER) {
+			cu_ = true;
+			cs_ += px[k];
+		    } else if (!narm) {
+			cna_ = true;
+			break;
+		    }
+		}
+		cs[c] = (lichunk_t) { cs_, cu_, cna_ };
+	    });
+	for (R_xlen_t c = 0; c < PAR_NCHUNKS(n); c++) {
+	    if (cs[c].na) {
+		vmaxset(vmax);
+		return NA_INTEGER;
+	    }
+	    if (cs[c].updated) updated = 1;
+	    s += cs[c].s;
+	    if (s > 9000000000000000L || s < -9000000000000000L) {
+		vmaxset(vmax);
+		return 42; /* switch to irsum() */
+	    }
+	}
+	vmaxset(vmax);
+	*value = s;
+	return updated;
+    }
+
     /**** assumes INTEGER(sx) and LOGICAL(sx) are identical!! */
     ITERATE_BY_REGION(sx, x, i, nbatch, int, INTEGER, {
 	    for (R_xlen_t k = 0; k < nbatch; k++) {
@@ -128,6 +203,37 @@ static bool risum(SEXP sx, double *value, bool narm)
     LDOUBLE s = 0.0;
     bool updated = false;
 
+    R_xlen_t n = XLENGTH(sx);
+    const int *px = INTEGER_OR_NULL(sx);
+    if (USE_CHUNKS(n, px)) {
+	const void *vmax = vmaxget();
+	ldchunk_t *cs = (ldchunk_t *) R_alloc(PAR_NCHUNKS(n), sizeof(ldchunk_t));
+	FOR_CHUNKS(n, c, lo, hi, {
+		LDOUBLE cs_ = 0.0;
+		bool cu_ = false, cna_ = false;
+		for (R_xlen_t k = lo; k < hi; k++) {
+		    if (px[k] != NA_INTEGER) {
+			cu_ = true;
+			cs_ += (double) px[k];
+		    } else if (!narm) {
+			cna_ = true;
+			break;
+		    }
+		}
+		cs[c] = (ldchunk_t) { cs_, cu_, cna_ };
+	    });
+	for (R_xlen_t c = 0; c < PAR_NCHUNKS(n); c++) {
+	    if (cs[c].na) {
+		vmaxset(vmax);
+		*value = NA_REAL;
+		return true;
+	    }
+	    if (cs[c].updated) updated = true;
+	    s += cs[c].s;
+	}
+	vmaxset(vmax);
+    }
+    else
     /**** assumes INTEGER(sx) and LOGICAL(sx) are identical!! */
     ITERATE_BY_REGION(sx, x, i, nbatch, int, INTEGER, {
 	    for (R_xlen_t k = 0; k < nbatch; k++) {
@@ -154,6 +260,28 @@ static bool rsum(SEXP sx, double *value, bool narm)
     LDOUBLE s = 0.0;
     bool updated = false;
 
+    R_xlen_t n = XLENGTH(sx);
+    const double *px = REAL_OR_NULL(sx);
+    if (USE_CHUNKS(n, px)) {
+	const void *vmax = vmaxget();
+	ldchunk_t *cs = (ldchunk_t *) R_alloc(PAR_NCHUNKS(n), sizeof(ldchunk_t));
+	FOR_CHUNKS(n, c, lo, hi, {
+		LDOUBLE cs_ = 0.0;
+		bool cu_ = false;
+		for (R_xlen_t k = lo; k < hi; k++)
+		    if (!narm || !ISNAN(px[k])) {
+			cu_ = true;
+			cs_ += px[k];
+		    }
+		cs[c] = (ldchunk_t) { cs_, cu_, false };
+	    });
+	for (R_xlen_t c = 0; c < PAR_NCHUNKS(n); c++) {
+	    if (cs[c].updated) updated = true;
+	    s += cs[c].s;
+	}
+	vmaxset(vmax);
+    }
+    else
     ITERATE_BY_REGION(sx, x, i, nbatch, double, REAL, {
 	    for (R_xlen_t k = 0; k < nbatch; k++) {
 		if (!narm || !ISNAN(x[k])) {
@@ -194,6 +322,43 @@ static bool imin(SEXP sx, int *value, bool narm)
     bool updated = false;
     int s = 0;
 
+    R_xlen_t n = XLENGTH(sx);
+    const int *px = INTEGER_OR_NULL(sx);
+    if (USE_CHUNKS(n, px)) {
+	const void *vmax = vmaxget();
+	ichunk_t *cs = (ichunk_t *) R_alloc(PAR_NCHUNKS(n), sizeof(ichunk_t));
+	FOR_CHUNKS(n, c, lo, hi, {
+		int cs_ = 0;
+		bool cu_ = false, cna_ = false;
+		for (R_xlen_t k = lo; k < hi; k++) {
+		    if (px[k] != NA_INTEGER) {
+			if (!cu_ || cs_ > px[k]) {
+			    cs_ = px[k];
+			    cu_ = true;
+			}
+		    } else if (!narm) {
+			cna_ = true;
+			break;
+		    }
+		}
+		cs[c] = (ichunk_t) { cs_, cu_, cna_ };
+	    });
+	for (R_xlen_t c = 0; c < PAR_NCHUNKS(n); c++) {
+	    if (cs[c].na) {
+		vmaxset(vmax);
+		*value = NA_INTEGER;
+		return(true);
+	    }
+	    if (cs[c].updated && (!updated || s > cs[c].s)) {
+		s = cs[c].s;
+		updated = true;
+	    }
+	}
+	vmaxset(vmax);
+	*value = s;
+	return updated;
+    }
+
     ITERATE_BY_REGION(sx, x, i, nbatch, int, INTEGER, {
 	    for (R_xlen_t k = 0; k < nbatch; k++) {
 		if (x[k] != NA_INTEGER) {
@@ -212,25 +377,48 @@ static bool imin(SEXP sx, int *value, bool narm)
     return updated;
 }
 
+/* Update the running minimum (maximum) s with x: any NA trumps all NaNs */
+#define RMINMAX_UPDATE(x, s, updated, narm, OP) do {			\
+	if (ISNAN(x)) {/* Na(N) */					\
+	    if (!narm) {						\
+		if(!ISNA(s)) s = x;					\
+		if(!updated) updated = true;				\
+	    }								\
+	}								\
+	else if (!updated || x OP s) { /* Never true if s is NA/NaN */	\
+	    s = x;							\
+	    if(!updated) updated = true;				\
+	}								\
+    } while (0)
+
 static bool rmin(SEXP sx, double *value, bool narm)
 {
     double s = 0.0; /* -Wall */
     bool updated = false;
 
-    /* s = R_PosInf; */
+    R_xlen_t n = XLENGTH(sx);
+    const double *px = REAL_OR_NULL(sx);
+    if (USE_CHUNKS(n, px)) {
+	/* a chunk's result is NaN only when it contained a NaN and
+	   !narm, so this gives the same result as a single pass */
+	const void *vmax = vmaxget();
+	dchunk_t *cs = (dchunk_t *) R_alloc(PAR_NCHUNKS(n), sizeof(dchunk_t));
+	FOR_CHUNKS(n, c, lo, hi, {
+		double cs_ = 0.0;
+		bool cu_ = false;
+		for (R_xlen_t k = lo; k < hi; k++)
+		    RMINMAX_UPDATE(px[k], cs_, cu_, narm, <);
+		cs[c] = (dchunk_t) { cs_, cu_ };
+	    });
+	for (R_xlen_t c = 0; c < PAR_NCHUNKS(n); c++)
+	    if (cs[c].updated)
+		RMINMAX_UPDATE(cs[c].s, s, updated, false, <);
+	vmaxset(vmax);
+    }
+    else
     ITERATE_BY_REGION(sx, x, i, nbatch, double, REAL, {
-	    for (R_xlen_t k = 0; k < nbatch; k++) {
-		if (ISNAN(x[k])) {/* Na(N) */
-		    if (!narm) {
-			if(!ISNA(s)) s = x[k]; /* so any NA trumps all NaNs */
-			if(!updated) updated = true;
-		    }
-		}
-		else if (!updated || x[k] < s) { /* Never true if s is NA/NaN */
-		    s = x[k];
-		    if(!updated) updated = true;
-		}
-	    }
+	    for (R_xlen_t k = 0; k < nbatch; k++)
+		RMINMAX_UPDATE(x[k], s, updated, narm, <);
 	});
     *value = s;
     return updated;
@@ -266,6 +454,43 @@ static bool imax(SEXP sx, int *value, bool narm)
     int s = 0 /* -Wall */;
     bool updated = false;
 
+    R_xlen_t n = XLENGTH(sx);
+    const int *px = INTEGER_OR_NULL(sx);
+    if (USE_CHUNKS(n, px)) {
+	const void *vmax = vmaxget();
+	ichunk_t *cs = (ichunk_t *) R_alloc(PAR_NCHUNKS(n), sizeof(ichunk_t));
+	FOR_CHUNKS(n, c, lo, hi, {
+		int cs_ = 0;
+		bool cu_ = false, cna_ = false;
+		for (R_xlen_t k = lo; k < hi; k++) {
+		    if (px[k] != NA_INTEGER) {
+			if (!cu_ || cs_ < px[k]) {
+			    cs_ = px[k];
+			    cu_ = true;
+			}
+		    } else if (!narm) {
+			cna_ = true;
+			break;
+		    }
+		}
+		cs[c] = (ichunk_t) { cs_, cu_, cna_ };
+	    });
+	for (R_xlen_t c = 0; c < PAR_NCHUNKS(n); c++) {
+	    if (cs[c].na) {
+		vmaxset(vmax);
+		*value = NA_INTEGER;
+		return(true);
+	    }
+	    if (cs[c].updated && (!updated || s < cs[c].s)) {
+		s = cs[c].s;
+		updated = true;
+	    }
+	}
+	vmaxset(vmax);
+	*value = s;
+	return updated;
+    }
+
     ITERATE_BY_REGION(sx, x, i, nbatch, int, INTEGER, {
 	    for (R_xlen_t k = 0; k < nbatch; k++) {
 		if (x[k] != NA_INTEGER) {
@@ -285,22 +510,32 @@ static bool imax(SEXP sx, int *value, bool narm)
 
 static bool rmax(SEXP sx, double *value, bool narm)
 {
-    double s = 0.0 /* -Wall */;
+    double s = 0.0; /* -Wall */
     bool updated = false;
 
+    R_xlen_t n = XLENGTH(sx);
+    const double *px = REAL_OR_NULL(sx);
+    if (USE_CHUNKS(n, px)) {
+	/* a chunk's result is NaN only when it contained a NaN and
+	   !narm, so this gives the same result as a single pass */
+	const void *vmax = vmaxget();
+	dchunk_t *cs = (dchunk_t *) R_alloc(PAR_NCHUNKS(n), sizeof(dchunk_t));
+	FOR_CHUNKS(n, c, lo, hi, {
+		double cs_ = 0.0;
+		bool cu_ = false;
+		for (R_xlen_t k = lo; k < hi; k++)
+		    RMINMAX_UPDATE(px[k], cs_, cu_, narm, >);
+		cs[c] = (dchunk_t) { cs_, cu_ };
+	    });
+	for (R_xlen_t c = 0; c < PAR_NCHUNKS(n); c++)
+	    if (cs[c].updated)
+		RMINMAX_UPDATE(cs[c].s, s, updated, false, >);
+	vmaxset(vmax);
+    }
+    else
     ITERATE_BY_REGION(sx, x, iii, nbatch, double, REAL, {
-	    for (R_xlen_t k = 0; k < nbatch; k++) {
-		if (ISNAN(x[k])) {/* Na(N) */
-		    if (!narm) {
-			if(!ISNA(s)) s = x[k]; /* so any NA trumps all NaNs */
-			if(!updated) updated = true;
-		    }
-		}
-		else if (!updated || x[k] > s) { /* Never true if s is NA/NaN */
-		    s = x[k];
-		    if(!updated) updated = true;
-		}
-	    }
+	    for (R_xlen_t k = 0; k < nbatch; k++)
+		RMINMAX_UPDATE(x[k], s, updated, narm, >);
 	});
     *value = s;
     return updated;
@@ -369,6 +604,28 @@ static bool rprod(SEXP sx, double *value, bool narm)
     LDOUBLE s = 1.0;
     bool updated = false;
 
+    R_xlen_t n = XLENGTH(sx);
+    const double *px = REAL_OR_NULL(sx);
+    if (USE_CHUNKS(n, px)) {
+	const void *vmax = vmaxget();
+	ldchunk_t *cs = (ldchunk_t *) R_alloc(PAR_NCHUNKS(n), sizeof(ldchunk_t));
+	FOR_CHUNKS(n, c, lo, hi, {
+		LDOUBLE cs_ = 1.0;
+		bool cu_ = false;
+		for (R_xlen_t k = lo; k < hi; k++)
+		    if (!narm || !ISNAN(px[k])) {
+			cu_ = true;
+			cs_ *= px[k];
+		    }
+		cs[c] = (ldchunk_t) { cs_, cu_, false };
+	    });
+	for (R_xlen_t c = 0; c < PAR_NCHUNKS(n); c++) {
+	    if (cs[c].updated) updated = true;
+	    s *= cs[c].s;
+	}
+	vmaxset(vmax);
+    }
+    else
     ITERATE_BY_REGION(sx, x, i, nbatch, double, REAL, {
 	    for (R_xlen_t k = 0; k < nbatch; k++) {
 		if (!narm || !ISNAN(x[k])) {
@@ -476,10 +733,46 @@ static R_INLINE SEXP integer_mean(SEXP x)
     return ScalarReal((double) (s/n));
 }
 
+/* sum((x - m) / d), by chunks as for rsum() */
+static LDOUBLE chunked_rsum(const double *px, R_xlen_t n, LDOUBLE m, double d)
+{
+    LDOUBLE s = 0.0;
+    const void *vmax = vmaxget();
+    LDOUBLE *cs = (LDOUBLE *) R_alloc(PAR_NCHUNKS(n), sizeof(LDOUBLE));
+    FOR_CHUNKS(n, c, lo, hi, {
+	    LDOUBLE cs_ = 0.0;
+	    if (d == 1)
+		for (R_xlen_t k = lo; k < hi; k++)
+		    cs_ += (px[k] - m);
+	    else
+		for (R_xlen_t k = lo; k < hi; k++)
+		    cs_ += (px[k] - m)/d;
+	    cs[c] = cs_;
+	});
+    for (R_xlen_t c = 0; c < PAR_NCHUNKS(n); c++)
+	s += cs[c];
+    vmaxset(vmax);
+    return s;
+}
+
 static R_INLINE SEXP real_mean(SEXP x)
 {
     R_xlen_t n = XLENGTH(x);
     LDOUBLE s = 0.0;
+    const double *px = REAL_OR_NULL(x);
+    if (USE_CHUNKS(n, px)) {
+	s = chunked_rsum(px, n, 0.0, 1);
+	if (R_FINITE((double) s)) {
+	    s /= n;
+	    if (R_FINITE((double) s))
+		s += chunked_rsum(px, n, s, 1)/n;
+	} else {
+	    s = chunked_rsum(px, n, 0.0, (double) n);
+	    if (R_FINITE((double) s))
+		s += chunked_rsum(px, n, s, (double) n);
+	}
+	return ScalarReal((double) s);
+    }
     ITERATE_BY_REGION(x, dx, i, nbatch, double, REAL, {
 	    for (R_xlen_t k = 0; k < nbatch; k++)
 		s += dx[k];
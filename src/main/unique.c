@@ -77,11 +77,20 @@ struct _HashData {
     Rboolean useCloEnv;
     Rboolean extptrAsRef;
     Rboolean inHashtab;
+    int nparts;
 };
 
 #define HTDATA_INT(d) (INTEGER0((d)->HashTable))
 #define HTDATA_DBL(d) (REAL0((d)->HashTable))
 
+/* The next slot to probe after i.  If the table has been split into
+   d->nparts > 1 partitions (see parHashing below), probing wraps
+   round within the partition containing i. */
+#define HT_PMASK(d) ((d)->M / (hlen) (d)->nparts - 1)
+#define HT_NEXT(i, d) ((d)->nparts > 1 ?				\
+		       ((i) & ~HT_PMASK(d)) | (((i) + 1) & HT_PMASK(d)) : \
+		       ((i) + 1) % (d)->M)
+
 
 /*
    Integer keys are hashed via a random number generator
@@ -540,7 +549,7 @@ static int isDuplicated(SEXP x, R_xlen_t indx, HashData *d)
 	while (h[i] != NIL) {
 	    if (d->equal(x, (R_xlen_t) h[i], x, indx))
 		return h[i] >= 0 ? 1 : 0;
-	    i = (i + 1) % d->M;
+	    i = HT_NEXT(i, d);
 	}
 	if (d->nmax-- < 0) error("hash table is full");
 	h[i] = (double) indx;
@@ -552,7 +561,7 @@ static int isDuplicated(SEXP x, R_xlen_t indx, HashData *d)
 	while (h[i] != NIL) {
 	    if (d->equal(x, h[i], x, indx))
 		return h[i] >= 0 ? 1 : 0;
-	    i = (i + 1) % d->M;
+	    i = HT_NEXT(i, d);
 	}
 	if (d->nmax-- < 0) error("hash table is full");
 	h[i] = (int) indx;
@@ -614,7 +623,7 @@ static void removeEntry(SEXP table, SEXP x, R_xlen_t indx, HashData *d)
 		h[i] = NA_INTEGER;  /* < 0, only index values are inserted */
 		return;
 	    }
-	    i = (i + 1) % d->M;
+	    i = HT_NEXT(i, d);
 	}
     } else
 #endif
@@ -626,9 +635,130 @@ static void removeEntry(SEXP table, SEXP x, R_xlen_t indx, HashData *d)
 		h[i] = NA_INTEGER;  /* < 0, only index values are inserted */
 		return;
 	    }
-	    i = (i + 1) % d->M;
+	    i = HT_NEXT(i, d);
+	}
+    }
+}
+
+/* Parallel hashing of long vectors.
+
+   The table is split into nparts partitions of M / nparts slots (both
+   powers of two), given by the leading bits of the hash value, and
+   probing for a key never leaves the partition of its hash value (see
+   HT_NEXT).  The hash values of all the keys are computed in parallel
+   and the indices of the keys sorted by partition, keeping the order
+   of the serial loops within each.  Thread p then inserts the keys of
+   partition p in that order, so the first occurrence of each value is
+   found exactly as by the serial code.  Lookups of other keys in the table
+   only read it and so can be done in parallel (see HashLookup).
+
+   This is only done for keys which can be hashed and compared without
+   allocation or calls back into R: non-ALTREP integer and double
+   vectors, and character vectors of cached strings of unknown
+   encoding, which are compared by address. */
+
+static bool ptrStrings(SEXP x)
+{
+    R_xlen_t n = XLENGTH(x);
+    const SEXP *px = STRING_PTR_RO(x);
+    for (R_xlen_t i = 0; i < n; i++)
+	if (!IS_CACHED(px[i]) || ENC_KNOWN(px[i])) return FALSE;
+    return TRUE;
+}
+
+/* Number of threads to use for hashing or looking up the elements of
+   x, 1 if this is to be done serially. */
+static int hashThreads(SEXP x, HashData *d)
+{
+    int nth = R_par_nthreads(XLENGTH(x));
+    if (nth < 2 || ALTREP(x)) return 1;
+#ifdef LONG_VECTOR_SUPPORT
+    if (d->isLong) return 1;
+#endif
+    switch (TYPEOF(x)) {
+    case INTSXP:
+    case REALSXP:
+	return nth;
+    case STRSXP:
+	if (!d->useCache || d->useUTF8 || d->inHashtab || !ptrStrings(x))
+	    return 1;
+	return nth;
+    default:
+	return 1;
+    }
+}
+
+/* Insert the elements of x into the (empty) table using nth threads,
+   recording in v (unless NULL) which ones are duplicated.  A partition
+   can fill up only if the hash values are very unevenly spread: then
+   the table is cleared and FALSE is returned, for the caller to use
+   the serial code. */
+static bool parHashing(SEXP x, int *v, Rboolean from_last, HashData *d,
+		       int nth)
+{
+    int nparts = 1, pbits = 0;
+    while (2 * nparts <= nth && pbits < d->K - 1) {
+	nparts *= 2;
+	pbits++;
+    }
+    if (nparts < 2) return FALSE;
+    d->nparts = nparts;
+
+    /* n <= INT_MAX as long vectors are not hashed in parallel */
+    int n = (int) XLENGTH(x);
+    hlen psize = d->M / nparts;
+    int pshift = d->K - pbits, *h = HTDATA_INT(d);
+    bool full = FALSE;
+    const void *vmax = vmaxget();
+    int *hv = (int *) R_alloc((size_t) n, sizeof(int)),
+	*idx = (int *) R_alloc((size_t) n, sizeof(int)),
+	*start = (int *) R_alloc((size_t) nparts + 1, sizeof(int));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) schedule(static)
+#endif
+    for (int k = 0; k < n; k++)
+	hv[k] = (int) d->hash(x, k, d);
+    /* counting sort of the indices by partition */
+    for (int p = 0; p <= nparts; p++) start[p] = 0;
+    for (int k = 0; k < n; k++) start[(hv[k] >> pshift) + 1]++;
+    for (int p = 0; p < nparts; p++) start[p + 1] += start[p];
+    for (int k = 0; k < n; k++) {
+	int indx = from_last ? n - 1 - k : k;
+	idx[start[hv[indx] >> pshift]++] = indx;
+    }
+    /* now start[p] is the end of partition p */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nparts) schedule(static) reduction(||:full)
+#endif
+    for (int p = 0; p < nparts; p++) {
+	hlen left = psize - 1; /* leave an empty slot to end probing */
+	for (int j = p == 0 ? 0 : start[p - 1]; j < start[p]; j++) {
+	    int indx = idx[j], dup = 0;
+	    hlen i = (hlen) hv[indx];
+	    while (h[i] != NIL) {
+		if (d->equal(x, h[i], x, indx)) {
+		    dup = 1;
+		    break;
+		}
+		i = HT_NEXT(i, d);
+	    }
+	    if (!dup) {
+		if (left-- == 0) {
+		    full = TRUE;
+		    break;
+		}
+		h[i] = indx;
+	    }
+	    if (v) v[indx] = dup;
 	}
     }
+    vmaxset(vmax);
+    if (full) {
+	for (hlen i = 0; i < d->M; i++) h[i] = NIL;
+	d->nparts = 1;
+	return FALSE;
+    }
+    return TRUE;
 }
 
 #define DUPLICATED_INIT						\
@@ -652,7 +782,10 @@ SEXP duplicated(SEXP x, Rboolean from_last)
 
     v = LOGICAL(ans);
 
-    if(from_last)
+    int nth = nmax == NA_INTEGER ? hashThreads(x, &data) : 1;
+    if (nth > 1 && parHashing(x, v, from_last, &data, nth))
+	;
+    else if(from_last)
 	for (i = n-1; i >= 0; i--) {
 //	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
 	    v[i] = isDuplicated(x, i, &data);
@@ -846,7 +979,10 @@ static SEXP Duplicated(SEXP x, Rboolean from_last, int nmax)
 
     v = LOGICAL(ans);
 
-    if(from_last)
+    int nth = nmax == NA_INTEGER ? hashThreads(x, &data) : 1;
+    if (nth > 1 && parHashing(x, v, from_last, &data, nth))
+	;
+    else if(from_last)
 	for (i = n-1; i >= 0; i--) {
 //	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
 	    v[i] = isDuplicated(x, i, &data);
@@ -1023,7 +1159,10 @@ static SEXP duplicated3(SEXP x, SEXP incomp, Rboolean from_last, int nmax)
 
     v = LOGICAL(ans);
 
-    if(from_last)
+    int nth = nmax == NA_INTEGER ? hashThreads(x, &data) : 1;
+    if (nth > 1 && parHashing(x, v, from_last, &data, nth))
+	;
+    else if(from_last)
 	for (i = n-1; i >= 0; i--) {
 //	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
 	    v[i] = isDuplicated(x, i, &data);
@@ -1240,7 +1379,7 @@ static void UndoHashing(SEXP x, SEXP table, HashData *d)
 	while (h[i] != NIL) {					\
 	    if (EQLFUN(table, h[i], x, indx))			\
 		return h[i] >= 0 ? h[i] + 1 : d->nomatch;	\
-	    i = (i + 1) % d->M;					\
+	    i = HT_NEXT(i, d);					\
 	}							\
 	return d->nomatch;					\
     }
@@ -1263,6 +1402,35 @@ static SEXP HashLookup(SEXP table, SEXP x, HashData *d)
     PROTECT(ans = allocVector(INTSXP, n));
     int *pa = INTEGER0(ans);
 
+    int nth = hashThreads(x, d);
+    if (nth > 1 && TYPEOF(x) == STRSXP && !ptrStrings(table)) nth = 1;
+    if (nth > 1) {
+	switch (TYPEOF(x)) {
+	case INTSXP:
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) schedule(static)
+#endif
+	    for (i = 0; i < n; i++)
+		pa[i] = iLookup(table, x, i, d);
+	    break;
+	case REALSXP:
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) schedule(static)
+#endif
+	    for (i = 0; i < n; i++)
+		pa[i] = rLookup(table, x, i, d);
+	    break;
+	default: /* STRSXP */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) schedule(static)
+#endif
+	    for (i = 0; i < n; i++)
+		pa[i] = sLookup(table, x, i, d);
+	}
+	UNPROTECT(1);
+	return ans;
+    }
+
     switch (TYPEOF(x)) {
     case INTSXP:
 	for (i = 0; i < n; i++)
@@ -1336,6 +1504,120 @@ static SEXP asUTF8(SEXP x)
 }
 
 // workhorse of R's match() and hence also  " ix %in% itable "
+/* Coerce to a common type; type == NILSXP is ok here.
+ * Note that match_transform() coerces factors and "POSIXlt", only to
+ * character.  Hence, coerce to character or to `higher' type
+ * (given that we have "Vector" or NULL) */
+static SEXPTYPE matchType(SEXP x, SEXP table)
+{
+    if(TYPEOF(x) >= STRSXP || TYPEOF(table) >= STRSXP) return STRSXP;
+    else return TYPEOF(x) < TYPEOF(table) ? TYPEOF(table) : TYPEOF(x);
+}
+
+/* Summary of the strings of a table for match5(): the scan stops at
+   the first string which is in "bytes" encoding or not cached. */
+#define TS_BYTES	1 /* stopped at a "bytes" string */
+#define TS_UNCACHED	2 /* stopped at an uncached string */
+#define TS_ENC		4 /* a string of known encoding up to the stop */
+
+static int tableStrings(SEXP table)
+{
+    int flags = 0;
+    for(int i = 0; i < LENGTH(table); i++) {
+	SEXP s = STRING_ELT(table, i);
+	if(IS_BYTES(s)) return flags | TS_BYTES;
+	if(ENC_KNOWN(s)) flags |= TS_ENC;
+	if(!IS_CACHED(s)) return flags | TS_UNCACHED;
+    }
+    return flags;
+}
+
+/* Cache of hash tables for match(), enabled by options(match.cache = n)
+   for n > 0.  The hash tables of the n most recently used tables of at
+   least MATCH_CACHE_MIN elements are kept, keyed by the table as passed
+   to match() and the type it is coerced to.  Only tables which are not
+   objects are cached, and not when 'incomparables' are given.
+
+   Each entry is a list of the key, the table after coercion, its hash
+   table and a raw vector holding a MatchCacheInfo.  Holding the key
+   increases its reference count, so an R-level modification of a
+   cached table makes a copy, for which the entry is not used.  (C code
+   which modifies a shared vector in place breaks this, as it does much
+   else.)  Entries are freed when they fall off the end of the list or
+   the option is reduced. */
+#define MATCH_CACHE_MIN 1000
+
+typedef struct {
+    HashData d;
+    SEXPTYPE type;
+    int tflags; /* tableStrings() for a character table */
+} MatchCacheInfo;
+
+#define MC_KEY(e)	VECTOR_ELT(e, 0)
+#define MC_TABLE(e)	VECTOR_ELT(e, 1)
+#define MC_HASHTAB(e)	VECTOR_ELT(e, 2)
+#define MC_INFO(e)	((MatchCacheInfo *) RAW(VECTOR_ELT(e, 3)))
+
+/* CDR is the list of entries, most recently used first */
+static SEXP R_MatchCache = NULL;
+
+static SEXP matchCacheGet(SEXP key, SEXPTYPE type)
+{
+    if (R_MatchCache == NULL) return NULL;
+    for (SEXP prev = R_MatchCache, e = CDR(prev); e != R_NilValue;
+	 prev = e, e = CDR(e)) {
+	SEXP entry = CAR(e);
+	if (MC_KEY(entry) == key && MC_INFO(entry)->type == type) {
+	    if (prev != R_MatchCache) { /* move to the front */
+		SETCDR(prev, CDR(e));
+		SETCDR(e, CDR(R_MatchCache));
+		SETCDR(R_MatchCache, e);
+	    }
+	    return entry;
+	}
+    }
+    return NULL;
+}
+
+static void matchCachePut(SEXP key, SEXP table, HashData *d, SEXPTYPE type,
+			  int tflags)
+{
+    if (R_MatchCache == NULL) {
+	R_MatchCache = CONS(R_NilValue, R_NilValue);
+	R_PreserveObject(R_MatchCache);
+    }
+    /* remove any entry for key made with different string settings */
+    for (SEXP prev = R_MatchCache, e = CDR(prev); e != R_NilValue;
+	 prev = e, e = CDR(e))
+	if (MC_KEY(CAR(e)) == key && MC_INFO(CAR(e))->type == type) {
+	    SETCDR(prev, CDR(e));
+	    break;
+	}
+    SEXP entry = PROTECT(allocVector(VECSXP, 4));
+    SET_VECTOR_ELT(entry, 0, key);
+    SET_VECTOR_ELT(entry, 1, table);
+    SET_VECTOR_ELT(entry, 2, d->HashTable);
+    SET_VECTOR_ELT(entry, 3, allocVector(RAWSXP, sizeof(MatchCacheInfo)));
+    MatchCacheInfo *info = MC_INFO(entry);
+    info->d = *d;
+    info->d.HashTable = NULL; /* held by the entry */
+    info->type = type;
+    info->tflags = tflags;
+    SETCDR(R_MatchCache, CONS(entry, CDR(R_MatchCache)));
+    UNPROTECT(1);
+    R_TrimMatchCache();
+}
+
+/* Drop the entries beyond the first R_MatchCacheSize */
+attribute_hidden void R_TrimMatchCache(void)
+{
+    if (R_MatchCache == NULL) return;
+    SEXP e = R_MatchCache;
+    for (int i = 0; i < R_MatchCacheSize && CDR(e) != R_NilValue; i++)
+	e = CDR(e);
+    SETCDR(e, R_NilValue);
+}
+
 static /* or attribute_hidden? */
 SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
 {
@@ -1351,9 +1633,10 @@ SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
 	return ans;
     }
 
-    SEXP x, table;
+    SEXP x, table, cached = NULL;
     int nprot = 2; /* x, table */
     PROTECT_INDEX xpi, tbpi;
+    bool cacheable = FALSE;
 
     bool D1; /* special case  <Date> o <character> */
     if ((D1 = isObject(ix)     && inherits(ix,     "Date") && isValidString(itable)) ||
@@ -1380,21 +1663,22 @@ SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
 	}
     } else { /* regular cases */
 	PROTECT_WITH_INDEX(x     = match_transform(ix,     env),  &xpi);
-        PROTECT_WITH_INDEX(table = match_transform(itable, env), &tbpi);
+	cacheable = R_MatchCacheSize > 0 && !incomp && !OBJECT(itable) &&
+	    XLENGTH(itable) >= MATCH_CACHE_MIN;
+	if (cacheable)
+	    cached = matchCacheGet(itable, matchType(x, itable));
+	if (cached)
+	    PROTECT_WITH_INDEX(table = MC_TABLE(cached), &tbpi);
+	else
+	    PROTECT_WITH_INDEX(table = match_transform(itable, env), &tbpi);
     }
 
-    SEXPTYPE type;
-    /* Coerce to a common type; type == NILSXP is ok here.
-     * Note that above we coerce factors and "POSIXlt", only to character.
-     * Hence, coerce to character or to `higher' type
-     * (given that we have "Vector" or NULL) */
-    if(TYPEOF(x) >= STRSXP || TYPEOF(table) >= STRSXP) type = STRSXP;
-    else type = TYPEOF(x) < TYPEOF(table) ? TYPEOF(table) : TYPEOF(x);
+    SEXPTYPE type = matchType(x, table);
     REPROTECT(x	    = coerceVector(x,	  type),  xpi);
     REPROTECT(table = coerceVector(table, type), tbpi);
 
     // special case scalar x -- for speed only :
-    if(XLENGTH(x) == 1 && !incomp) {
+    if(XLENGTH(x) == 1 && !incomp && !cached) {
       int val = nmatch;
       int ntable = LENGTH(table);
       switch (type) {
@@ -1455,13 +1739,11 @@ SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
     else { // regular case
 	HashData data = { 0 };
 	if (incomp) { PROTECT(incomp = coerceVector(incomp, type)); nprot++; }
-	data.nomatch = nmatch;
-	HashTableSetup(table, &data, NA_INTEGER);
-	PROTECT(data.HashTable); nprot++;
+	Rboolean useUTF8 = FALSE;
+	Rboolean useCache = TRUE;
+	int tflags = 0;
 	if(type == STRSXP) {
 	    Rboolean useBytes = FALSE;
-	    Rboolean useUTF8 = FALSE;
-	    Rboolean useCache = TRUE;
 	    for(R_xlen_t i = 0; i < xlength(x); i++) {
 		SEXP s = STRING_ELT(x, i);
 		if(IS_BYTES(s)) {
@@ -1478,31 +1760,40 @@ SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
 		}
 	    }
 	    if(!useBytes || useCache) {
-		for(int i = 0; i < LENGTH(table); i++) {
-		    SEXP s = STRING_ELT(table, i);
-		    if(IS_BYTES(s)) {
-			useBytes = TRUE;
-			useUTF8 = FALSE;
-			break;
-		    }
-		    if(ENC_KNOWN(s)) {
-			useUTF8 = TRUE;
-		    }
-		    if(!IS_CACHED(s)) {
-			useCache = FALSE;
-			break;
-		    }
-		}
+		tflags = cached ? MC_INFO(cached)->tflags
+		    : tableStrings(table);
+		if(tflags & TS_BYTES) {
+		    useBytes = TRUE;
+		    useUTF8 = FALSE;
+		} else if(tflags & TS_ENC)
+		    useUTF8 = TRUE;
+		if(tflags & TS_UNCACHED)
+		    useCache = FALSE;
 	    }
 	    if(useUTF8) {
 		x = PROTECT(asUTF8(x)); nprot++;
-		table = PROTECT(asUTF8(table)); nprot++;
+		SEXP utable = asUTF8(table);
+		if (utable != table) cacheable = FALSE;
+		table = PROTECT(utable); nprot++;
 	    }
+	}
+	if (cached && MC_INFO(cached)->d.useUTF8 == useUTF8 &&
+	    MC_INFO(cached)->d.useCache == useCache) {
+	    data = MC_INFO(cached)->d;
+	    data.HashTable = MC_HASHTAB(cached);
+	} else {
+	    HashTableSetup(table, &data, NA_INTEGER);
+	    PROTECT(data.HashTable); nprot++;
 	    data.useUTF8 = useUTF8;
 	    data.useCache = useCache;
+	    int nth = hashThreads(table, &data);
+	    if (nth == 1 || !parHashing(table, NULL, FALSE, &data, nth))
+		DoHashing(table, &data);
+	    if (incomp) UndoHashing(incomp, table, &data);
+	    if (cacheable)
+		matchCachePut(itable, table, &data, type, tflags);
 	}
-	DoHashing(table, &data);
-	if (incomp) UndoHashing(incomp, table, &data);
+	data.nomatch = nmatch;
 	ans = HashLookup(table, x, &data);
     }
     UNPROTECT(nprot);